@@ -1,135 +1,34 @@
 #include "arm.h"
-#include <cmath>
+#include <limits>
 
-#define STEP_SIZE .05
+JointAxes::JointAxes (void)
+  : dofs (3), axes (Eigen::Matrix3f::Identity ()) {};
 
-using namespace Eigen;
-using namespace std;
-
-Matrix3f crossmat (const Vector3f& v);
-Matrix4f rodriguez (const Vector3f& v);
-Matrix4f translation (const Vector3f& v);
-Vector3f applyTransform (const Matrix4f& t, const Vector3f& v3);
-
-Arm::Arm (float x, float y, float z) {
-  this->tip = Vector3f (x, y, z);
+JointAxes::JointAxes (const Eigen::Vector3f& axis)
+  : dofs (1), axes (Eigen::Matrix3f::Zero ()) {
+  this->axes.col (0) = axis.normalized ();
 };
 
-Arm::~Arm (void) {
-  // Delete all joints.
-  for (list<Vector3f*>::iterator it = this->joints.begin ();
-       it != this->joints.end ();
-       it++) {
-    delete *it;
-  }
-}
-
-int Arm::numJoints (void) {
-  return this->joints.size () + 1;
-}
-
-// TODO: Design a better interface. This is lazy.
-Matrix3Xf Arm::getJoints (void) {
-  Matrix3Xf joints (3, this->numJoints ());
-  int i = 0;
-  // For each joint (in outward order),
-  for (list<Vector3f*>::iterator it = this->joints.begin ();
-       it != this->joints.end ();
-       it++) {
-    joints.block<3,1>(0,i++) = **it;
-  }
-  joints.block<3,1>(0,i) = this->tip;
-  return joints;
+JointAxes::JointAxes (const Eigen::Vector3f& axis1,
+                      const Eigen::Vector3f& axis2)
+  : dofs (2), axes (Eigen::Matrix3f::Zero ()) {
+  this->axes.col (0) = axis1.normalized ();
+  this->axes.col (1) = (axis2 - this->axes.col (0).dot (axis2)
+    * this->axes.col (0)).normalized ();
 };
 
-void Arm::addJoint (float x, float y, float z) {
-  Vector3f *newJoint = new Vector3f (this->tip);
-  this->tip = Vector3f (x, y, z);
-  this->joints.push_back (newJoint);
-};
+JointLimits::JointLimits (void)
+  : lower (Eigen::Vector3f::Constant (
+      -std::numeric_limits<float>::infinity ())),
+    upper (Eigen::Vector3f::Constant (
+      std::numeric_limits<float>::infinity ())) {};
 
-Matrix<float, 3, Dynamic> Arm::jacobian (void) {
-  // Initialize Jacobian.
-  Matrix3Xf jacobian (3, 3 * this->joints.size ());
-  int i = 0;
-  // For each joint (in outward order),
-  for (list<Vector3f*>::iterator it = this->joints.begin ();
-       it != this->joints.end ();
-       it++) {
-    // Calculate the diff between joint and end effector.
-    Vector3f diff = **it - this->tip;
-    // Take the crossmat of the diff and append it to Jacobian.
-    jacobian.block<3,3>(0,3*i++) = crossmat (diff);
-  }
-  return jacobian;
-};
-
-void Arm::applyRotations (Vector3f *expmaps) {
-  // Set transform as identity 4x4 matrix.
-  Matrix4f transform = Matrix4f::Identity ();
-  int i = 0;
-  // For each joint (in outward order),
-  for (list<Vector3f*>::iterator it = this->joints.begin ();
-       it != this->joints.end ();
-       it++) {
-    // Take the joint...
-    Vector3f joint = **it;
-    // Apply the accumulated transform to the joint.
-    **it = applyTransform (transform, joint);
-    // Add joint rotation to transform.
-    transform *= translation (joint) * rodriguez (expmaps[i++])
-      * translation (-joint);
-  }
-  // Apply the final transform to the end effector.
-  this->tip = applyTransform (transform, this->tip);
-};
+JointLimits::JointLimits (const Eigen::Vector3f& lower,
+                          const Eigen::Vector3f& upper)
+  : lower (lower), upper (upper) {};
 
-void Arm::stepTowards (Vector3f goal) {
-  // Take the jacobian.
-  Matrix3Xf jacobian = this->jacobian ();
-  // Calculate error.
-  Vector3f err = goal - this->tip;
-  // Solve least-squares for error = jacobian * x.
-  VectorXf x = jacobian.jacobiSvd(ComputeThinU|ComputeThinV).solve (err);
-  // Turn x into array of Vector3fs.
-  int length = this->joints.size ();
-  Vector3f *expmaps = new Vector3f[length];
-  for (int i = 0; i < length; i++) {
-    expmaps[i] = x.block<3,1>(3*i,0);
-  }
-  // applyRotations.
-  applyRotations (expmaps);
-  delete [] expmaps;
-};
-
-Matrix3f crossmat (const Vector3f& v) {
-  Matrix3f m;
-  m << 0, -v(2), v(1),
-       v(2), 0, -v(0),
-       -v(1), v(0), 0;
-  return m;
-};
-
-Matrix4f rodriguez (const Vector3f& r) {
-  Matrix4f m4 = Matrix4f::Identity ();
-  float norm = sqrt (r.dot (r));
-  Vector3f rn = r / norm;
-  Matrix3f cross = crossmat (rn);
-  m4.block<3,3>(0,0) = rn * rn.transpose ()
-                       + sin (norm * STEP_SIZE) * cross
-                       - cos (norm * STEP_SIZE) * cross * cross;
-  return m4;
-};
-
-Matrix4f translation (const Vector3f& v) {
-  Matrix4f m = Matrix4f::Identity ();
-  m.block<3,1>(0,3) = v;
-  return m;
-};
-
-Vector3f applyTransform (const Matrix4f& t, const Vector3f& v3) {
-  Vector4f v4;
-  v4 << v3, 1;
-  v4 = t * v4;
-  return v4.head (3) / v4(3);
-};
+// The members are defined in armimpl.h. The common arms are instantiated
+// here once, so files using them don't each compile their own copy.
+template class BasicArm<Eigen::Dynamic>;
+template class BasicArm<Eigen::Dynamic, double>;
+template class BasicArm<Eigen::Dynamic, double, float>;
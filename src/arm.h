@@ -2,26 +2,275 @@
 #define ARM_H
 
 #include "Eigen/Dense"
-#include <list>
+#include "armstats.h"
+#include "jacobian.h"
 
-// TODO: use vector or deque instead of list.
-// Only reason for using list here is because I thought it would
-// be confusing to use vector, but I changed my mind.
+#define DEFAULT_DAMPING .1
+#define DEFAULT_RENORMALIZATION 64
+#define LIMIT_PASSES 4
+#define LM_MAX_ATTEMPTS 8
+#define LM_MIN_DAMPING 1e-6
+#define LM_MAX_DAMPING 1e4
 
-class Arm {
+// Joints are stored as the columns of one contiguous matrix, in outward
+// order, with the end effector (tip) as the last column. The positions
+// are derived: each link keeps its rest-pose offset and the rotation
+// accumulated since, and every applyRotations recomputes the positions
+// from the root by forward kinematics. Rounding error then only ever
+// touches the link rotations, which are renormalized every so often (see
+// setRenormalization), so link lengths hold however long the arm runs.
+
+// Strategies stepTowards can use to solve err = J x for the joint
+// rotations x, or, for IK_CCD and IK_FABRIK, to turn the joints without
+// J. All of them cost O(N) per step for N joints.
+enum IKSolver {
+  IK_SVD,        // Pseudo-inverse through an SVD of J (the default).
+  IK_DLS,        // Damped least squares, J^T (J J^T + lambda^2 I)^-1 err.
+  IK_SDLS,       // Selectively damped least squares (Buss and Kim).
+  IK_TRANSPOSE,  // Jacobian transpose with the error-minimizing step size.
+  IK_CG,         // Damped least squares by matrix-free conjugate gradients
+                 // on J^T J, warm started from the previous step.
+  IK_CCD,        // Cyclic coordinate descent: one sweep from the tip in,
+                 // turning each joint in closed form.
+  IK_FABRIK,     // Forward and backward reaching (Aristidou and Lasenby):
+                 // one pass each way over the joint positions. Ball joints
+                 // only; arms with hinges or limits step by IK_CCD.
+  IK_LM          // Levenberg-Marquardt: whole damped least squares steps,
+                 // with lambda adapted to how well each one does.
+};
+
+// Why Arm::solve stopped.
+enum IKStatus {
+  IK_CONVERGED,        // The tip is within tolerance of the goal.
+  IK_MAX_ITERATIONS,   // The iteration budget ran out.
+  IK_TIME_BUDGET,      // Another step would overrun the time budget.
+  IK_NO_JOINTS         // The arm has no joints to move the tip with.
+};
+
+struct IKResult {
+  int iterations;      // Steps taken.
+  float error;         // Final distance from the tip to the goal, or
+                       // for a pose goal the size of its weighted error.
+  IKStatus status;
+};
+
+// The axes a joint rotates about, as orthonormal columns in its parent
+// link's rest-pose axes (the world axes for the first joint). A ball
+// joint (the default) turns about all three; a hinge about one axis, and
+// a universal joint about two, the second made orthogonal to the first.
+// Each axis is one column of J, so hinges make J narrower.
+struct JointAxes {
+  int dofs;
+  Eigen::Matrix3f axes;
+  JointAxes (void);
+  JointAxes (const Eigen::Vector3f& axis);
+  JointAxes (const Eigen::Vector3f& axis1, const Eigen::Vector3f& axis2);
+};
+
+// Bounds on a joint's rotation about each of its axes, in radians. A
+// joint's rotation is taken relative to its parent link, as a rotation
+// vector in the parent's rest-pose axes, so every joint is at zero in
+// the rest pose; component k bounds its projection on the joint's k-th
+// axis (x, y and z for a ball joint). Equal bounds lock that axis. The
+// default is unbounded.
+struct JointLimits {
+  Eigen::Vector3f lower, upper;
+  JointLimits (void);
+  JointLimits (const Eigen::Vector3f& lower, const Eigen::Vector3f& upper);
+};
+
+// Weights on a pose goal's error: the tip's position (x, y, z), then its
+// rotation about x, y and z, in radians. A weight of zero leaves that
+// axis free; weights also set how far a radian counts against a unit of
+// distance.
+typedef Eigen::Matrix<float, 6, 1> PoseWeights;
+
+// Solver state carried from one step to the next, so a goal that moves
+// only a little can reuse the last factorization (see Arm::setCoherence).
+template <typename Scalar, typename SolveScalar>
+struct ArmCache {
+  bool valid;                                // Whether the factors below
+  int uses;                                  // are usable, and the steps
+  Eigen::Matrix<Scalar, 3, 1> goal;          // and goal they served.
+  IKSolver solver;
+  float damping;
+  Eigen::Matrix<SolveScalar, 3, 3> u, w;     // J = U S (Q W)^T, with Q
+  Eigen::Matrix<SolveScalar, 3, 1> sv;       // left in the q workspace.
+  ArmCache (void) : valid (false), uses (0) {};
+};
+
+// The solver workspace (QR factor, CG right-hand side and per-joint
+// expmaps) is sized to the arm's dofs, three per ball joint and fewer for
+// hinges (see JointAxes), and resized only in addJoint, so stepTowards
+// never touches the heap, except inside Eigen's CG for IK_CG. stepTowards
+// never forms J either: the solvers work through jacobianOperator (),
+// which reads the joint positions left by the last applyRotations. Only
+// the SVD solvers write it out, as the J^T they factor; an arm with
+// hinges also writes out its (narrower) J once per step. jacobian ()
+// fills a dense copy on request.
+//
+// N is the number of rotating joints. Arm (N = Dynamic) grows with each
+// addJoint. A BasicArm<N> with N fixed at compile time keeps all of its
+// state in fixed-size matrices inside the object, with no heap at all,
+// and lets Eigen unroll the small per-step kernels. It starts with every
+// point at the root; addJoint then places the points in order, and points
+// not yet placed sit on the tip, where they leave it alone. Like any
+// fixed-size Eigen type, keep it in aligned containers (see
+// Eigen::aligned_allocator).
+//
+// Scalar is the type joint positions are kept and integrated in, and
+// SolveScalar the type the jacobian is solved in. Positions pick up
+// rounding error on every applyRotations, which is what makes long float
+// chains drift, while the solve starts afresh each step. So a mixed arm
+// (double positions, float solve) drifts like a double one but solves at
+// float speed; its solver works on a float copy of the joints taken
+// relative to the tip, which keeps the differences J is made of exact to
+// float precision.
+//
+// An arm with more dofs than the goal has rows leaves a nullspace, moves
+// of the joints that don't move the tip. setNullspace spends it on
+// secondary objectives: keeping near the rest pose, keeping clear of
+// joint limits, and keeping the arm well conditioned. Their gradient is
+// projected with the factorization the solver already made, so it costs
+// a few more O(N) passes per step.
+//
+// A pose goal also asks for the tip's orientation: the rotation of the
+// last link from its rest pose (see tipRotation). Its error is the
+// rotation from there to the goal as a rotation vector, the form
+// rodriguez takes, and J gains three rows for it (see ArmJacobian).
+
+template <int N, typename Scalar = float, typename SolveScalar = Scalar>
+class BasicArm {
+  public:
+    enum {
+      Points = N == Eigen::Dynamic ? int (Eigen::Dynamic) : N + 1,
+      Dofs = N == Eigen::Dynamic ? int (Eigen::Dynamic) : 3 * N
+    };
+    typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+    typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
+    typedef Eigen::Matrix<Scalar, 3, Points> JointMatrix;
+    typedef Eigen::Matrix<SolveScalar, 3, Dofs> JacobianMatrix;
+    typedef Eigen::Matrix<SolveScalar, 3, Eigen::Dynamic> ExpmapMatrix;
+    typedef ArmJacobian<SolveScalar> Jacobian;
   private:
-    Eigen::Vector3f tip;
-    std::list<Eigen::Vector3f*> joints;
-    Eigen::Matrix3Xf jacobian (void);
+    typedef Eigen::Matrix<SolveScalar, 3, 1> SolveVector3;
+    typedef Eigen::Matrix<SolveScalar, 3, 3> SolveMatrix3;
+    typedef Eigen::Matrix<SolveScalar, 6, 1> SolveVector6;
+    typedef Eigen::Matrix<SolveScalar, 6, 6> SolveMatrix6;
+    typedef Eigen::Ref<Eigen::Matrix<SolveScalar, Eigen::Dynamic, 1> >
+      SolveVectorRef;
+    JointMatrix joints;
+    Eigen::Matrix<SolveScalar, 3, Points> solveJoints;
+    JointMatrix reach;
+    JointMatrix undoJoints;
+    Eigen::Matrix<Scalar, 3, Dofs> undoRotations;
+    Eigen::Matrix<SolveScalar, 3, Dofs> undoAxes;
+    JacobianMatrix denseJac;
+    Eigen::Matrix<SolveScalar, Dofs, 3> q;
+    Eigen::Matrix<SolveScalar, Dofs, 1> rhs;
+    Eigen::Matrix<SolveScalar, 3, N> expmaps;
+    Eigen::Matrix<Scalar, 3, N> rest;
+    Eigen::Matrix<Scalar, 3, Dofs> rotations;
+    Eigen::Matrix<Scalar, 3, Dofs> turns;
+    Eigen::Matrix<Scalar, 3, N> lower, upper;
+    Eigen::Matrix<SolveScalar, Dofs, 2> box;
+    Eigen::Matrix<SolveScalar, 3, Dofs> localJac;
+    bool limited;
+    Eigen::Matrix<Scalar, 3, Dofs> localAxes;
+    Eigen::Matrix<SolveScalar, 3, Dofs> worldAxes;
+    Eigen::Matrix<int, Points, 1> firstDof;
+    Eigen::Matrix<SolveScalar, Dofs, 1> dofSteps;
+    Eigen::Matrix<SolveScalar, Dofs, 1> secondary;
+    Eigen::Matrix<SolveScalar, 3, 3> dampedGram;
+    float restWeight, limitWeight, manipulabilityWeight;
+    bool reduced;
+    int added;
+    IKSolver solver;
+    float damping;
+    float lmDamping, lmGrowth;
+    ArmCache<Scalar, SolveScalar> cache;
+    float coherenceDelta;
+    int coherenceSteps;
+    int renormalizeSteps;
+    int unnormalized;
+    ArmStats stats;
+    void forwardKinematics (void);
+    void factor (SolveMatrix3& u, SolveVector3& sv, SolveMatrix3& w);
+    void stepCCD (const Vector3& goal);
+    void stepFABRIK (const Vector3& goal);
+    void stepLM (const Vector3& goal);
+    void solveSVD (const Jacobian& jac, const SolveVector3& err,
+                   SolveVectorRef x);
+    void solveDLS (const Jacobian& jac, const SolveVector3& err,
+                   SolveVectorRef x);
+    void solveSDLS (const Jacobian& jac, const SolveVector3& err,
+                    SolveVectorRef x);
+    void solveTranspose (const Jacobian& jac, const SolveVector3& err,
+                         SolveVectorRef x);
+    void solveCG (const Jacobian& jac, const SolveVector3& err,
+                  SolveVectorRef x);
+    void applyLimits (const Jacobian& jac, const SolveVector3& err,
+                      SolveVectorRef x, int passes);
+    void solveStep (const Jacobian& jac, const SolveVector3& err,
+                    SolveVectorRef x);
+    void addNullspace (const Jacobian& jac, SolveVectorRef x);
+    void solvePose (const Jacobian& jac, const SolveVector6& err,
+                    const SolveVector6& weights, SolveVectorRef x);
+    template <typename Solve>
+    void takeStep (int dofs, Solve solve);
+    template <typename Step, typename Error>
+    IKResult iterate (Step step, Error error, float tolerance, int maxIters,
+                      double timeBudget);
+    Eigen::Matrix<Scalar, 6, 1> poseError (const Vector3& goal,
+                                           const Matrix3& orientation,
+                                           const PoseWeights& weights) const;
+    Eigen::Matrix<Scalar, 3, 3> parentRotation (int i) const;
+    void placeAxes (int i, const Eigen::Matrix<Scalar, 3, 3>& parent);
   public:
-    Arm (void) : Arm (0, 0, 0) {};
-    Arm (float x, float y, float z);
-    ~Arm (void);
-    void addJoint (float x, float y, float z);
-    void applyRotations (Eigen::Vector3f *expmaps);
-    void stepTowards (Eigen::Vector3f goal);
-    int numJoints (void);
-    Eigen::Matrix<float, 3, Eigen::Dynamic> getJoints (void);
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    BasicArm (void) : BasicArm (0, 0, 0) {};
+    BasicArm (Scalar x, Scalar y, Scalar z);
+    void addJoint (Scalar x, Scalar y, Scalar z,
+                   const JointLimits& limits = JointLimits ());
+    void addJoint (Scalar x, Scalar y, Scalar z, const JointAxes& axes,
+                   const JointLimits& limits = JointLimits ());
+    void applyRotations (const Eigen::Ref<const ExpmapMatrix>& expmaps);
+    const JacobianMatrix& jacobian (void);
+    Jacobian jacobianOperator (void);
+    void stepTowards (Vector3 goal);
+    void stepTowards (Vector3 goal, const Matrix3& orientation,
+                      const PoseWeights& weights = PoseWeights::Ones ());
+    IKResult solve (Vector3 goal, float tolerance, int maxIters,
+                    double timeBudget = 0);
+    IKResult solve (Vector3 goal, const Matrix3& orientation,
+                    float tolerance, int maxIters, double timeBudget = 0,
+                    const PoseWeights& weights = PoseWeights::Ones ());
+    void setSolver (IKSolver solver);
+    void setDamping (float lambda);
+    void setCoherence (float goalDelta, int steps);
+    void setRenormalization (int steps);
+    void setNullspace (float rest, float limits = 0,
+                       float manipulability = 0);
+    const ArmStats& getStats (void) const;
+    void resetStats (void);
+    int numJoints (void) const;
+    int numDofs (void) const;
+    const JointMatrix& getJoints (void) const;
+    Vector3 jointRotation (int i) const;
+    Matrix3 tipRotation (void) const;
 };
 
+// Float throughout, double throughout, and double positions with a float
+// solve.
+typedef BasicArm<Eigen::Dynamic> Arm;
+typedef BasicArm<Eigen::Dynamic, double> Armd;
+typedef BasicArm<Eigen::Dynamic, double, float> ArmMixed;
+
+#include "armimpl.h"
+
+// These are compiled once, in arm.cpp.
+extern template class BasicArm<Eigen::Dynamic>;
+extern template class BasicArm<Eigen::Dynamic, double>;
+extern template class BasicArm<Eigen::Dynamic, double, float>;
+
 #endif
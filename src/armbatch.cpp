@@ -0,0 +1,60 @@
+#include "armbatch.h"
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Eigen;
+using namespace std;
+
+ArmBatch::ArmBatch (void) : cost (1, 0), threads (0) {};
+
+// Adds a copy of arm to the batch and returns its index.
+int ArmBatch::add (const Arm& arm) {
+  this->arms.push_back (arm);
+  // cost[i] is the total joint count of arms before i.
+  this->cost.push_back (this->cost.back () + arm.numJoints ());
+  return this->arms.size () - 1;
+};
+
+Arm& ArmBatch::getArm (int i) {
+  return this->arms[i];
+};
+
+int ArmBatch::size (void) const {
+  return this->arms.size ();
+};
+
+// Sets the number of threads to step with. 0 means the OpenMP default.
+void ArmBatch::setThreads (int threads) {
+  this->threads = threads;
+};
+
+// Returns the first arm of the given thread's share of the work.
+int ArmBatch::rangeStart (int thread, int numThreads) const {
+  long target = this->cost.back () * thread / numThreads;
+  return lower_bound (this->cost.begin (), this->cost.end (), target)
+         - this->cost.begin ();
+};
+
+// Steps arm i towards goals.col (i), for every arm in the batch.
+void ArmBatch::stepTowards (const Matrix3Xf& goals) {
+  int n = this->arms.size ();
+#ifdef _OPENMP
+  int numThreads = this->threads > 0 ? this->threads : omp_get_max_threads ();
+  #pragma omp parallel num_threads(numThreads)
+  {
+    int t = omp_get_thread_num ();
+    int nt = omp_get_num_threads ();
+    int end = min (n, rangeStart (t + 1, nt));
+    for (int i = rangeStart (t, nt); i < end; i++) {
+      this->arms[i].stepTowards (goals.col (i));
+    }
+  }
+#else
+  for (int i = 0; i < n; i++) {
+    this->arms[i].stepTowards (goals.col (i));
+  }
+#endif
+};
@@ -0,0 +1,29 @@
+#ifndef ARMBATCH_H
+#define ARMBATCH_H
+
+#include "arm.h"
+#include <vector>
+
+// A set of independent arms stepped together, one goal per arm, spread
+// across cores with OpenMP. Each arm only ever touches its own state, so
+// results are the same for any thread count.
+//
+// Work is split into contiguous ranges of equal total joint count rather
+// than equal arm count, since a step costs O(joints).
+
+class ArmBatch {
+  private:
+    std::vector<Arm> arms;
+    std::vector<long> cost;
+    int threads;
+    int rangeStart (int thread, int numThreads) const;
+  public:
+    ArmBatch (void);
+    int add (const Arm& arm);
+    Arm& getArm (int i);
+    int size (void) const;
+    void setThreads (int threads);
+    void stepTowards (const Eigen::Matrix3Xf& goals);
+};
+
+#endif
@@ -0,0 +1,1139 @@
+#ifndef ARMIMPL_H
+#define ARMIMPL_H
+
+// Definitions of the BasicArm members, included from arm.h. Arm, Armd
+// and ArmMixed are compiled in arm.cpp; other sizes and types are
+// instantiated where they are used.
+
+#include "kinematics.h"
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+
+#define SDLS_MAX_ANGLE .785398 // pi / 4
+
+// Adds columns to an arm's joint matrices. Only a Dynamic arm can grow; a
+// fixed-size arm has every point from the start.
+template <int N>
+struct ArmGrowth {
+  template <typename Joints>
+  static void grow (Joints&, int) {};
+};
+
+template <>
+struct ArmGrowth<Eigen::Dynamic> {
+  template <typename Joints>
+  static void grow (Joints& joints, int cols) {
+    joints.conservativeResize (Eigen::NoChange, cols);
+  };
+};
+
+// The joint positions the solver works on. With one precision these are
+// the joints themselves; with two, a copy in the solve precision, taken
+// relative to the tip so the differences J is made of lose nothing to
+// large coordinates.
+template <typename Scalar, typename SolveScalar>
+struct ArmPrecision {
+  template <typename Joints, typename SolveJoints>
+  static const SolveJoints& positions (const Joints& joints,
+                                       SolveJoints& solveJoints) {
+    int length = joints.cols () - 1;
+    solveJoints = (joints.colwise () - joints.col (length))
+      .template cast<SolveScalar> ();
+    return solveJoints;
+  };
+};
+
+template <typename Scalar>
+struct ArmPrecision<Scalar, Scalar> {
+  template <typename Joints, typename SolveJoints>
+  static const Joints& positions (const Joints& joints, SolveJoints&) {
+    return joints;
+  };
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+BasicArm<N, Scalar, SolveScalar>::BasicArm (Scalar x, Scalar y, Scalar z)
+  : limited (false),
+    restWeight (0), limitWeight (0), manipulabilityWeight (0),
+    reduced (false), added (1), solver (IK_SVD), damping (DEFAULT_DAMPING),
+    lmDamping (DEFAULT_DAMPING * DEFAULT_DAMPING), lmGrowth (2),
+    coherenceDelta (0), coherenceSteps (0),
+    renormalizeSteps (DEFAULT_RENORMALIZATION), unnormalized (0) {
+  if (N == Eigen::Dynamic) {
+    this->joints.resize (3, 1);
+    this->solveJoints.resize (3, 1);
+    this->reach.resize (3, 1);
+    this->undoJoints.resize (3, 1);
+    this->firstDof.resize (1);
+  }
+  // Joints not yet placed have no dofs.
+  this->firstDof.setZero ();
+  this->joints.colwise () = Vector3 (x, y, z);
+  this->expmaps.setZero ();
+  // Links not yet placed have no length, and their joints no limits.
+  this->rest.setZero ();
+  this->lower.setConstant (-std::numeric_limits<Scalar>::infinity ());
+  this->upper.setConstant (std::numeric_limits<Scalar>::infinity ());
+  for (int i = 0; i < this->rest.cols (); i++) {
+    this->rotations.template block<3,3>(0,3*i).setIdentity ();
+  }
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::setSolver (IKSolver solver) {
+  this->solver = solver;
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::setDamping (float lambda) {
+  this->damping = lambda;
+  // IK_LM starts over from lambda.
+  this->lmDamping = lambda * lambda;
+  this->lmGrowth = 2;
+};
+
+// Lets stepTowards reuse the SVD of J (for IK_SVD and IK_SDLS) for up to
+// steps steps in a row, while the goal stays within goalDelta of the goal
+// it was computed for. A reused step solves with the slightly stale J of
+// an earlier pose, skipping the write-out of J^T and its factorization.
+// A goal that jumps further, or a change of solver or damping, refactors
+// at once. steps = 0 (the default) refactors every step. The other
+// solvers have no factorization worth keeping: mixing a stale J J^T with
+// the current J^T in DLS steps badly near singular poses, and IK_CG
+// already warm starts from the last step.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::setCoherence (float goalDelta,
+                                                     int steps) {
+  this->coherenceDelta = goalDelta;
+  this->coherenceSteps = steps;
+};
+
+// Orthonormalizes the link rotations every steps calls to applyRotations,
+// undoing the rounding error their products pick up. 0 never does. Each
+// pass costs about as much as one applyRotations.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::setRenormalization (int steps) {
+  this->renormalizeSteps = steps;
+};
+
+// Weights on the secondary objectives stepTowards pursues in the
+// nullspace of J, for position goals: rest pulls each joint back towards
+// its rest pose, limits towards the middle of its range (on axes bounded
+// both ways), and manipulability towards poses where J is well
+// conditioned, raising log det (J J^T + lambda^2 I). All zero (the
+// default) leaves the nullspace alone. IK_CCD, IK_FABRIK and IK_LM
+// ignore them.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::setNullspace (float rest,
+                                                     float limits,
+                                                     float manipulability) {
+  this->restWeight = rest;
+  this->limitWeight = limits;
+  this->manipulabilityWeight = manipulability;
+};
+
+// Stage timings since construction or the last resetStats. All zero
+// unless built with ARM_STATS.
+template <int N, typename Scalar, typename SolveScalar>
+const ArmStats& BasicArm<N, Scalar, SolveScalar>::getStats (void) const {
+  return this->stats;
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::resetStats (void) {
+  this->stats = ArmStats ();
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+int BasicArm<N, Scalar, SolveScalar>::numJoints (void) const {
+  return this->joints.cols ();
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+const typename BasicArm<N, Scalar, SolveScalar>::JointMatrix&
+BasicArm<N, Scalar, SolveScalar>::getJoints (void) const {
+  return this->joints;
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+int BasicArm<N, Scalar, SolveScalar>::numDofs (void) const {
+  int length = this->joints.cols () - 1;
+  return this->reduced ? this->firstDof (length) : 3 * length;
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::addJoint (
+  Scalar x, Scalar y, Scalar z, const JointLimits& limits) {
+  addJoint (x, y, z, JointAxes (), limits);
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::addJoint (
+  Scalar x, Scalar y, Scalar z, const JointAxes& axes,
+  const JointLimits& limits) {
+  // The old tip becomes a joint and the new point becomes the tip. The
+  // axes and limits are that joint's.
+  int n = this->added++;
+  int dofs = this->firstDof (n - 1) + axes.dofs;
+  if (N == Eigen::Dynamic) {
+    ArmGrowth<N>::grow (this->joints, n + 1);
+    ArmGrowth<N>::grow (this->solveJoints, n + 1);
+    ArmGrowth<N>::grow (this->reach, n + 1);
+    ArmGrowth<N>::grow (this->rest, n);
+    ArmGrowth<N>::grow (this->rotations, 3 * n);
+    ArmGrowth<N>::grow (this->lower, n);
+    ArmGrowth<N>::grow (this->upper, n);
+    ArmGrowth<N>::grow (this->localAxes, dofs);
+    this->firstDof.conservativeResize (n + 1);
+    // Size the solver workspace for n rotating joints.
+    this->q.resize (dofs, 3);
+    this->rhs.resize (dofs);
+    this->expmaps.resize (3, n);
+    this->box.resize (dofs, 2);
+    this->localJac.resize (3, dofs);
+    this->worldAxes.resize (3, dofs);
+    this->dofSteps.resize (dofs);
+    this->secondary.resize (dofs);
+    this->undoJoints.resize (3, n + 1);
+    this->undoRotations.resize (3, 3 * n);
+    this->turns.resize (3, 3 * n);
+    this->undoAxes.resize (3, dofs);
+  }
+  assert (n < this->joints.cols ());
+  this->reduced = this->reduced || axes.dofs < 3;
+  this->localAxes.middleCols (this->firstDof (n - 1), axes.dofs) =
+    axes.axes.leftCols (axes.dofs).template cast<Scalar> ();
+  this->firstDof.tail (this->firstDof.size () - n).setConstant (dofs);
+  if (this->reduced) {
+    for (int i = 0; i < n; i++) placeAxes (i, parentRotation (i));
+  }
+  // A narrower J leaves rows of q unused; they must stay zero for factor.
+  this->q.setZero ();
+  this->dofSteps.setZero ();
+  // The new link rests where it is placed, relative to the current pose.
+  Vector3 point (x, y, z);
+  this->rest.col (n - 1) = point - this->joints.col (n - 1);
+  this->rotations.template block<3,3>(0,3*(n-1)).setIdentity ();
+  this->lower.col (n - 1) = limits.lower.template cast<Scalar> ();
+  this->upper.col (n - 1) = limits.upper.template cast<Scalar> ();
+  float unbounded = std::numeric_limits<float>::infinity ();
+  this->limited = this->limited
+    || (limits.lower.array () > -unbounded).any ()
+    || (limits.upper.array () < unbounded).any ();
+  // Points not yet placed follow the tip.
+  this->joints.rightCols (this->joints.cols () - n).colwise () = point;
+  // The CG solver warm starts from the last solution, so start at zero.
+  this->expmaps.setZero ();
+  this->cache.valid = false;
+};
+
+// Joint i's rotation relative to its parent link (see JointLimits).
+template <int N, typename Scalar, typename SolveScalar>
+typename BasicArm<N, Scalar, SolveScalar>::Vector3
+BasicArm<N, Scalar, SolveScalar>::jointRotation (int i) const {
+  Eigen::AngleAxis<Scalar> local (parentRotation (i).transpose ()
+    * this->rotations.template block<3,3>(0,3*i));
+  return local.angle () * local.axis ();
+};
+
+// The rotation of the last link from its rest pose, which is the tip's
+// orientation for pose goals.
+template <int N, typename Scalar, typename SolveScalar>
+typename BasicArm<N, Scalar, SolveScalar>::Matrix3
+BasicArm<N, Scalar, SolveScalar>::tipRotation (void) const {
+  return parentRotation (this->joints.cols () - 1);
+};
+
+// The accumulated rotation of the link joint i hangs from; the identity
+// for the root.
+template <int N, typename Scalar, typename SolveScalar>
+Eigen::Matrix<Scalar, 3, 3>
+BasicArm<N, Scalar, SolveScalar>::parentRotation (int i) const {
+  if (i == 0) return Eigen::Matrix<Scalar, 3, 3>::Identity ();
+  return this->rotations.template block<3,3>(0,3*(i-1));
+};
+
+// Fills a dense copy of the jacobian of the tip position with respect to
+// the joint expmaps and returns it. The solvers don't use it; it is sized
+// here, on first use, rather than in addJoint.
+// A fixed-size arm with joints of fewer than three dofs has a narrower J,
+// and the columns past numDofs () are zero.
+template <int N, typename Scalar, typename SolveScalar>
+const typename BasicArm<N, Scalar, SolveScalar>::JacobianMatrix&
+BasicArm<N, Scalar, SolveScalar>::jacobian (void) {
+  Jacobian jac = jacobianOperator ();
+  if (N == Eigen::Dynamic) this->denseJac.resize (3, jac.cols ());
+  else this->denseJac.setZero ();
+  jac.evalTo (this->denseJac.leftCols (jac.cols ()));
+  return this->denseJac;
+};
+
+// The jacobian as an operator over the current joint positions, in the
+// solve precision. Until some joint has fewer than three dofs, its
+// columns are for the world axes and it is never written out. After,
+// every joint has a column for each of its own axes, in world axes as
+// applyRotations last left them, and they are written into localJac.
+template <int N, typename Scalar, typename SolveScalar>
+typename BasicArm<N, Scalar, SolveScalar>::Jacobian
+BasicArm<N, Scalar, SolveScalar>::jacobianOperator (void) {
+  const Eigen::Matrix<SolveScalar, 3, Points>& positions =
+    ArmPrecision<Scalar, SolveScalar>::positions (this->joints,
+                                                  this->solveJoints);
+  if (!this->reduced) return Jacobian (positions);
+  int length = this->joints.cols () - 1;
+  for (int i = 0; i < length; i++) {
+    SolveVector3 lever = positions.col (i) - positions.col (length);
+    for (int j = this->firstDof (i); j < this->firstDof (i + 1); j++) {
+      this->localJac.col (j) = lever.cross (this->worldAxes.col (j));
+    }
+  }
+  return Jacobian (positions,
+                   this->localJac.leftCols (this->firstDof (length)),
+                   this->worldAxes.leftCols (this->firstDof (length)));
+};
+
+// Rotates each joint i by expmaps.col (i) (scaled by STEP_SIZE, see
+// rodriguez) about its current position, carrying every joint further
+// out along with it. Link i is turned by the product of the rotations of
+// joints 0 to i, and that is folded into its accumulated rotation; the
+// positions are then rebuilt from the root.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::applyRotations (
+  const Eigen::Ref<const ExpmapMatrix>& expmaps) {
+  int length = this->joints.cols () - 1;
+  bool renormalize = this->renormalizeSteps > 0
+    && ++this->unnormalized >= this->renormalizeSteps;
+  if (renormalize) this->unnormalized = 0;
+  // Every joint's own rotation at once, then their running product.
+  rodriguezBatch (expmaps.leftCols (length).template cast<Scalar> (),
+                  this->turns);
+  Matrix3 turn = Matrix3::Identity ();
+  for (int i = 0; i < length; i++) {
+    turn *= this->turns.template block<3,3>(0,3*i);
+    Matrix3 rotation = turn * this->rotations.template block<3,3>(0,3*i);
+    if (renormalize) rotation = orthonormalize (rotation);
+    this->rotations.template block<3,3>(0,3*i) = rotation;
+    if (this->reduced && i + 1 < length) placeAxes (i + 1, rotation);
+  }
+  forwardKinematics ();
+};
+
+// Turns joint i's axes into world axes by its parent link's rotation.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::placeAxes (
+  int i, const Eigen::Matrix<Scalar, 3, 3>& parent) {
+  for (int j = this->firstDof (i); j < this->firstDof (i + 1); j++) {
+    this->worldAxes.col (j) =
+      (parent * this->localAxes.col (j)).template cast<SolveScalar> ();
+  }
+};
+
+// Places each point at the one before it plus its link's rest offset,
+// rotated. The root never moves.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::forwardKinematics (void) {
+  int length = this->joints.cols () - 1;
+  for (int i = 0; i < length; i++) {
+    this->joints.col (i + 1) = this->joints.col (i)
+      + this->rotations.template block<3,3>(0,3*i) * this->rest.col (i);
+  }
+};
+
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::stepTowards (Vector3 goal) {
+  int length = this->joints.cols () - 1;
+  if (length == 0) return;
+  ARM_COUNT (this->stats.steps);
+  if (this->solver == IK_FABRIK && !this->reduced && !this->limited) {
+    stepFABRIK (goal);
+    return;
+  }
+  if (this->solver == IK_CCD || this->solver == IK_FABRIK) {
+    stepCCD (goal);
+    return;
+  }
+  if (this->solver == IK_LM) {
+    stepLM (goal);
+    return;
+  }
+  // Keep the last factorization while the goal stays close to the one it
+  // was made for; otherwise start afresh.
+  bool reuse = this->cache.valid
+    && this->cache.uses < this->coherenceSteps
+    && this->cache.solver == this->solver
+    && this->cache.damping == this->damping
+    && (goal - this->cache.goal).norm () <= this->coherenceDelta;
+  if (reuse) {
+    ARM_COUNT (this->stats.reuses);
+  } else {
+    this->cache.valid = false;
+    this->cache.uses = 0;
+    this->cache.goal = goal;
+    this->cache.solver = this->solver;
+    this->cache.damping = this->damping;
+  }
+  this->cache.uses++;
+  Jacobian jac = jacobianOperator ();
+  int dofs = jac.cols ();
+  // The SVD solvers factor J^T, so write it out for them. The others
+  // only take products with J and never form it.
+  if (!reuse && (this->solver == IK_SVD || this->solver == IK_SDLS)) {
+    ARM_TIME_SCOPE (this->stats.jacobian);
+    jac.evalTransposeTo (this->q.topRows (dofs));
+  }
+  // Calculate error.
+  SolveVector3 err =
+    (goal - this->joints.col (length)).template cast<SolveScalar> ();
+  // Solve err = jacobian * x.
+  takeStep (dofs, [&] (SolveVectorRef x) { solveStep (jac, err, x); });
+};
+
+// Steps towards a pose: the tip at goal, and turned to orientation (see
+// tipRotation), with the error on each axis scaled by weights.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::stepTowards (
+  Vector3 goal, const Matrix3& orientation, const PoseWeights& weights) {
+  int length = this->joints.cols () - 1;
+  if (length == 0) return;
+  ARM_COUNT (this->stats.steps);
+  // The cached factors are of the position rows alone.
+  this->cache.valid = false;
+  Jacobian jac = jacobianOperator ();
+  SolveVector6 err = poseError (goal, orientation, weights)
+    .template cast<SolveScalar> ();
+  SolveVector6 w = weights.template cast<SolveScalar> ();
+  takeStep (jac.cols (), [&] (SolveVectorRef x) {
+    solvePose (jac, err, w, x);
+  });
+};
+
+// Cyclic coordinate descent. Visits each joint from the tip inwards and
+// turns it, in closed form, to bring the tip as close to the goal as its
+// axes allow: a ball joint by the rotation taking the tip's direction to
+// the goal's, and a hinge by the angle between them about its axis (each
+// axis in turn for a universal joint), clamped to the joint's limits.
+// Turning a joint moves nothing further in, so only the tip needs
+// following, and each turn is written to expmaps. applyRotations then
+// composes them, which is O(N) where turning everything further out at
+// every joint would be O(N^2). Unlike the other solvers, the turns are
+// not scaled down by STEP_SIZE: a step is a whole sweep.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::stepCCD (const Vector3& goal) {
+  int length = this->joints.cols () - 1;
+  // expmaps are scaled by STEP_SIZE when applied (see rodriguez).
+  const Scalar step = STEP_SIZE;
+  {
+    ARM_TIME_SCOPE (this->stats.solve);
+    Vector3 tip = this->joints.col (length);
+    for (int i = length - 1; i >= 0; i--) {
+      Vector3 joint = this->joints.col (i);
+      Vector3 from = tip - joint, to = goal - joint;
+      Vector3 angle;
+      if (this->limited) angle = jointRotation (i);
+      Vector3 turn;
+      if (this->reduced) {
+        Matrix3 rotation = Matrix3::Identity ();
+        for (int j = this->firstDof (i); j < this->firstDof (i + 1); j++) {
+          Vector3 axis = this->worldAxes.col (j).template cast<Scalar> ();
+          Scalar theta = std::atan2 (axis.dot (from.cross (to)),
+            from.dot (to) - axis.dot (from) * axis.dot (to));
+          if (this->limited) {
+            int k = j - this->firstDof (i);
+            Scalar turned = this->localAxes.col (j).dot (angle);
+            theta = std::min (std::max (theta, this->lower(k,i) - turned),
+                              this->upper(k,i) - turned);
+          }
+          Eigen::AngleAxis<Scalar> about (theta, axis);
+          rotation = about * rotation;
+          from = about * from;
+        }
+        Eigen::AngleAxis<Scalar> total (rotation);
+        turn = total.angle () * total.axis ();
+      } else {
+        Vector3 cross = from.cross (to);
+        Scalar sine = cross.norm ();
+        turn = sine > 0 ? Vector3 (cross * (std::atan2 (sine, from.dot (to))
+          / sine)) : Vector3::Zero ();
+        if (this->limited) {
+          Matrix3 parent = parentRotation (i);
+          Vector3 local = parent.transpose () * turn;
+          local = local.cwiseMax (this->lower.col (i) - angle)
+            .cwiseMin (this->upper.col (i) - angle);
+          turn = parent * local;
+        }
+        Scalar theta = turn.norm ();
+        if (theta > 0) from = Eigen::AngleAxis<Scalar> (theta, turn / theta)
+          * from;
+      }
+      tip = joint + from;
+      this->expmaps.col (i) = (turn / step).template cast<SolveScalar> ();
+    }
+  }
+  {
+    ARM_TIME_SCOPE (this->stats.rotate);
+    applyRotations (this->expmaps);
+  }
+};
+
+// FABRIK (Aristidou and Lasenby, "FABRIK: A fast, iterative solver for
+// the Inverse Kinematics problem", 2011). A backward pass puts the tip on
+// the goal and pulls each joint in turn back towards where it was, at
+// its link's length from the next; a forward pass then puts the root
+// back and does the same outwards. The passes work on a copy of the
+// positions, in reach. The arm's state is its link rotations, so each
+// link is then turned by the shortest rotation onto its new direction and
+// the positions rebuilt from those; link lengths hold exactly, as they
+// do for every solver. Like CCD, a step is a whole iteration.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::stepFABRIK (const Vector3& goal) {
+  int length = this->joints.cols () - 1;
+  {
+    ARM_TIME_SCOPE (this->stats.solve);
+    this->reach.col (length) = goal;
+    for (int i = length - 1; i >= 0; i--) {
+      this->reach.col (i) = this->reach.col (i + 1) + this->rest.col (i)
+        .norm () * (this->joints.col (i) - this->reach.col (i + 1))
+        .normalized ();
+    }
+    this->reach.col (0) = this->joints.col (0);
+    for (int i = 0; i < length; i++) {
+      this->reach.col (i + 1) = this->reach.col (i) + this->rest.col (i)
+        .norm () * (this->reach.col (i + 1) - this->reach.col (i))
+        .normalized ();
+    }
+  }
+  {
+    ARM_TIME_SCOPE (this->stats.rotate);
+    bool renormalize = this->renormalizeSteps > 0
+      && ++this->unnormalized >= this->renormalizeSteps;
+    if (renormalize) this->unnormalized = 0;
+    for (int i = 0; i < length; i++) {
+      Eigen::Quaternion<Scalar> turn;
+      turn.setFromTwoVectors (this->joints.col (i + 1) - this->joints.col (i),
+                              this->reach.col (i + 1) - this->reach.col (i));
+      // Near a half turn, setFromTwoVectors's quaternion is far from unit.
+      Matrix3 rotation = turn.normalized ().toRotationMatrix ()
+        * this->rotations.template block<3,3>(0,3*i);
+      if (renormalize) rotation = orthonormalize (rotation);
+      this->rotations.template block<3,3>(0,3*i) = rotation;
+    }
+    forwardKinematics ();
+  }
+};
+
+// Levenberg-Marquardt. Damped least squares, but each step is taken
+// whole rather than scaled by STEP_SIZE, and lambda^2 (lmDamping) is
+// adapted to the ratio of the error the step actually removed to the
+// error J x predicts it would. A step that makes things worse is taken
+// back and tried again with more damping; one that does well, and the
+// model can be trusted, cuts the damping. The update is Nielsen's
+// ("Damping parameter in Marquardt's method", 1999). Every attempt reuses
+// the same J J^T, so one costs a 3x3 solve, J^T y and applyRotations;
+// the arm is put back from a copy of its rotations and positions.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::stepLM (const Vector3& goal) {
+  int length = this->joints.cols () - 1;
+  Jacobian jac = jacobianOperator ();
+  int dofs = jac.cols ();
+  // x is scaled by STEP_SIZE when applied (see rodriguez), so solve for
+  // err / STEP_SIZE to take the whole step.
+  const SolveScalar step = STEP_SIZE;
+  SolveVector3 err =
+    (goal - this->joints.col (length)).template cast<SolveScalar> () / step;
+  SolveScalar before = (step * err).squaredNorm ();
+  SolveMatrix3 gram = jac.gram ();
+  this->undoJoints = this->joints;
+  this->undoRotations = this->rotations;
+  if (this->reduced) this->undoAxes = this->worldAxes;
+  int unnormalized = this->unnormalized;
+  for (int attempt = 0; attempt < LM_MAX_ATTEMPTS; attempt++) {
+    SolveScalar predicted = 0;
+    takeStep (dofs, [&] (SolveVectorRef x) {
+      SolveMatrix3 damped = gram;
+      damped.diagonal ().array () += SolveScalar (this->lmDamping);
+      jac.transposeTimes (damped.ldlt ().solve (err), x);
+      if (this->limited) applyLimits (jac, err, x, LIMIT_PASSES);
+      predicted = before - (step * (err - jac * x)).squaredNorm ();
+    });
+    SolveScalar after = SolveScalar ((goal - this->joints.col (length))
+                                     .squaredNorm ());
+    SolveScalar rho = (before - after) / predicted;
+    if (predicted > 0 && rho > 0) {
+      SolveScalar t = 2 * rho - 1;
+      this->lmDamping = std::max (float (LM_MIN_DAMPING), this->lmDamping
+        * float (std::max (SolveScalar (1) / 3, 1 - t * t * t)));
+      this->lmGrowth = 2;
+      return;
+    }
+    this->joints = this->undoJoints;
+    this->rotations = this->undoRotations;
+    if (this->reduced) this->worldAxes = this->undoAxes;
+    this->unnormalized = unnormalized;
+    // Nothing left that J can reach.
+    if (!(predicted > 0)) return;
+    this->lmDamping = std::min (float (LM_MAX_DAMPING),
+                                this->lmDamping * this->lmGrowth);
+    this->lmGrowth *= 2;
+  }
+};
+
+// Solves for a step with solve (x) and applies it. With ball joints
+// alone x is written straight into the expmap columns, one 3-vector per
+// joint. Otherwise it has one angle per dof, and each joint's expmap is
+// its angles times its axes.
+template <int N, typename Scalar, typename SolveScalar>
+template <typename Solve>
+void BasicArm<N, Scalar, SolveScalar>::takeStep (int dofs, Solve solve) {
+  int length = this->joints.cols () - 1;
+  {
+    ARM_TIME_SCOPE (this->stats.solve);
+    if (this->reduced) {
+      SolveVectorRef x (this->dofSteps.head (dofs));
+      solve (x);
+      for (int i = 0; i < length; i++) {
+        this->expmaps.col (i).setZero ();
+        for (int j = this->firstDof (i); j < this->firstDof (i + 1); j++) {
+          this->expmaps.col (i) += this->worldAxes.col (j) * x(j);
+        }
+      }
+    } else {
+      Eigen::Map<Eigen::Matrix<SolveScalar, Dofs, 1> > x (
+        this->expmaps.data (), dofs);
+      solve (x);
+    }
+  }
+  // applyRotations.
+  {
+    ARM_TIME_SCOPE (this->stats.rotate);
+    applyRotations (this->expmaps);
+  }
+};
+
+// The tip's pose error, weighted: the offset to goal, then the rotation
+// taking the tip's orientation to orientation, as a rotation vector.
+template <int N, typename Scalar, typename SolveScalar>
+Eigen::Matrix<Scalar, 6, 1> BasicArm<N, Scalar, SolveScalar>::poseError (
+  const Vector3& goal, const Matrix3& orientation,
+  const PoseWeights& weights) const {
+  Eigen::Matrix<Scalar, 6, 1> err;
+  err.template head<3>() = goal - this->joints.col (this->joints.cols () - 1);
+  Eigen::AngleAxis<Scalar> turn (orientation * tipRotation ().transpose ());
+  err.template tail<3>() = turn.angle () * turn.axis ();
+  return err.cwiseProduct (weights.template cast<Scalar> ());
+};
+
+// Solves err = J x with the chosen solver, within the joint limits.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::solveStep (const Jacobian& jac,
+                                                  const SolveVector3& err,
+                                                  SolveVectorRef x) {
+  switch (this->solver) {
+    case IK_DLS: solveDLS (jac, err, x); break;
+    case IK_SDLS: solveSDLS (jac, err, x); break;
+    case IK_TRANSPOSE: solveTranspose (jac, err, x); break;
+    case IK_CG: solveCG (jac, err, x); break;
+    default: solveSVD (jac, err, x); break;
+  }
+  if (this->limited) applyLimits (jac, err, x, LIMIT_PASSES);
+  // After the limits, whose re-solve would undo it, and only clamped to
+  // them.
+  if (this->restWeight != 0 || this->limitWeight != 0
+      || this->manipulabilityWeight != 0) {
+    addNullspace (jac, x);
+    if (this->limited) applyLimits (jac, err, x, 0);
+  }
+};
+
+// Adds to x the weighted gradient of the secondary objectives (see
+// setNullspace), with what of it would move the tip taken out. The SVD
+// solvers have J = U S (Q W)^T factored already, and J's row space is
+// spanned by the columns of Q W with non-zero singular values, so that
+// projection is two products with Q. The others project with
+// z - J^T (J J^T)^+ J z, the pseudo-inverse from an eigendecomposition of
+// the gram, which IK_DLS has already formed, damped.
+//
+// Gradients are per dof, on the axes x is on, and x turns a joint by
+// about the same vector in its parent's axes. The rest objective is
+// 1 - cos of each joint's angle from rest, whose gradient is the axial
+// vector of the joint's rotation relative to its parent, so it needs no
+// logarithm. The manipulability gradient comes from how each dof turns
+// the levers d_k = joint k - tip: those further out all rotate with it,
+// which turns their part S of J J^T, and those further in all shift by
+// the same b x d_i. Both come down to sums over the joints further in,
+// so one pass out from the root gives every dof's derivative.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::addNullspace (const Jacobian& jac,
+                                                     SolveVectorRef x) {
+  int length = this->joints.cols () - 1;
+  int dofs = jac.cols ();
+  SolveVectorRef z (this->secondary.head (dofs));
+  bool svd = this->solver == IK_SVD || this->solver == IK_SDLS;
+  SolveMatrix3 gram;
+  if (this->solver == IK_DLS) {
+    gram = this->dampedGram;
+  } else if (this->manipulabilityWeight != 0 || !svd) {
+    gram = jac.gram ();
+    gram.diagonal ().array () += SolveScalar (this->damping * this->damping);
+  }
+  z.setZero ();
+  for (int i = 0; i < length; i++) {
+    if (this->restWeight == 0 && this->limitWeight == 0) break;
+    int begin = this->reduced ? this->firstDof (i) : 3 * i;
+    int end = this->reduced ? this->firstDof (i + 1) : 3 * i + 3;
+    Matrix3 parent = parentRotation (i);
+    // W P^T - P W^T is 2 sin (angle) crossmat (axis), in world axes, and
+    // (W P^T)(r,c) is row r of W dotted with row c of P.
+    Matrix3 link = this->rotations.template block<3,3>(0,3*i);
+    Vector3 pull = Scalar (this->restWeight) / 2 * Vector3 (
+      link.row (1).dot (parent.row (2)) - link.row (2).dot (parent.row (1)),
+      link.row (2).dot (parent.row (0)) - link.row (0).dot (parent.row (2)),
+      link.row (0).dot (parent.row (1)) - link.row (1).dot (parent.row (0)));
+    Vector3 away = Vector3::Zero ();
+    if (this->limited && this->limitWeight != 0) {
+      Vector3 angle = jointRotation (i);
+      for (int j = begin; j < end; j++) {
+        int k = j - begin;
+        Scalar half = (this->upper(k,i) - this->lower(k,i)) / 2;
+        if (!(half > 0 && half < std::numeric_limits<Scalar>::infinity ())) {
+          continue;
+        }
+        Scalar turned = this->reduced ?
+          this->localAxes.col (j).dot (angle) : angle(k);
+        away(k) = -Scalar (this->limitWeight)
+          * (turned - (this->lower(k,i) + half)) / (half * half);
+      }
+    }
+    if (this->reduced) {
+      for (int j = begin; j < end; j++) {
+        z(j) = SolveScalar (this->worldAxes.col (j).template cast<Scalar> ()
+                            .dot (pull) + away(j - begin));
+      }
+    } else {
+      z.template segment<3>(3*i) =
+        (pull + parent * away).template cast<SolveScalar> ();
+    }
+  }
+  if (this->manipulabilityWeight != 0) {
+    SolveMatrix3 inverse = gram.inverse ();
+    // d log w = d log det (gram) / 2.
+    SolveScalar weight = SolveScalar (this->manipulabilityWeight) / 2;
+    // h sums -2 (inverse c) x a over the columns c = d x a of this joint
+    // and those further in; for ball joints that is linear in the sum of
+    // their d, through spread. Turning the part S of the gram further out
+    // gives tr (inverse (b x S - S b x)) = -2 b . m, with m the axial
+    // vector of S inverse - inverse S. The whole gram commutes with
+    // inverse, so m is also minus that of the part further in, which is
+    // the sum of (inverse d) x d (or -(inverse c) x c per column) there.
+    SolveMatrix3 spread;
+    for (int b = 0; b < 3; b++) {
+      spread.col (b).setZero ();
+      for (int a = 0; a < 3; a++) {
+        SolveVector3 axis = SolveVector3::Unit (a);
+        spread.col (b) -= 2 * (inverse * SolveVector3::Unit (b)
+                               .cross (axis)).cross (axis);
+      }
+    }
+    SolveVector3 h = SolveVector3::Zero (), m = SolveVector3::Zero ();
+    SolveVector3 levers = SolveVector3::Zero ();
+    for (int i = 0; i < length; i++) {
+      SolveVector3 lever = jac.lever (i);
+      if (this->reduced) {
+        for (int j = this->firstDof (i); j < this->firstDof (i + 1); j++) {
+          SolveVector3 c = this->localJac.col (j);
+          SolveVector3 turned = inverse * c;
+          h -= 2 * turned.cross (this->worldAxes.col (j));
+          m -= turned.cross (c);
+        }
+        SolveVector3 g = weight * (lever.cross (h) - 2 * m);
+        for (int j = this->firstDof (i); j < this->firstDof (i + 1); j++) {
+          z(j) += this->worldAxes.col (j).dot (g);
+        }
+      } else {
+        levers += lever;
+        h.noalias () = spread * levers;
+        m += (inverse * lever).cross (lever);
+        z.template segment<3>(3*i) += weight * (lever.cross (h) - 2 * m);
+      }
+    }
+  }
+  if (svd) {
+    SolveMatrix3 u, w;
+    SolveVector3 sv;
+    factor (u, sv, w);
+    SolveScalar threshold =
+      std::max (sv(0) * 3 * Eigen::NumTraits<SolveScalar>::epsilon (),
+                std::numeric_limits<SolveScalar>::min ());
+    SolveVector3 y = w.transpose () * (this->q.topRows (dofs).transpose ()
+                                       * z);
+    for (int i = 0; i < 3; i++) {
+      if (!(sv(i) > threshold)) y(i) = 0;
+    }
+    z.noalias () -= this->q.topRows (dofs) * (w * y);
+  } else {
+    // Damping shifts every eigenvalue by lambda^2 and leaves the vectors.
+    Eigen::SelfAdjointEigenSolver<SolveMatrix3> eigen (gram);
+    SolveVector3 values = eigen.eigenvalues ().array ()
+      - SolveScalar (this->damping * this->damping);
+    // Rounding in the damped gram is relative to its largest eigenvalue.
+    SolveScalar threshold = std::max (eigen.eigenvalues ().maxCoeff () * 3
+      * Eigen::NumTraits<SolveScalar>::epsilon (),
+      std::numeric_limits<SolveScalar>::min ());
+    SolveVector3 y = eigen.eigenvectors ().transpose () * (jac * z);
+    for (int i = 0; i < 3; i++) {
+      y(i) = values(i) > threshold ? y(i) / values(i) : 0;
+    }
+    jac.addTransposeTimes (-(eigen.eigenvectors () * y), z);
+  }
+  x += z;
+};
+
+// Solves W err = W [J; A] x for a pose goal, with W the weights and err
+// already weighted, through the 6x6 gram of the weighted rows (see
+// ArmJacobian), so every solver is O(N) with a constant-size solve.
+// IK_DLS, IK_CG and IK_LM solve the damped normal equations directly,
+// with the damping set by setDamping rather than IK_LM's own; the
+// others but IK_TRANSPOSE take the pseudo-inverse from an
+// eigendecomposition of the gram, dropping directions it can't resolve,
+// without SDLS's clamping or any CCD or FABRIK pass; and
+// IK_TRANSPOSE steps along the weighted [J; A]^T err. Joint limits clamp
+// the step, but don't re-solve for what clamping it gave up.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::solvePose (const Jacobian& jac,
+                                                  const SolveVector6& err,
+                                                  const SolveVector6& weights,
+                                                  SolveVectorRef x) {
+  if (this->solver == IK_TRANSPOSE) {
+    jac.poseTransposeTimes (weights.cwiseProduct (err), x);
+    SolveVector6 moved = weights.cwiseProduct (jac.poseTimes (x));
+    SolveScalar denom = moved.dot (moved);
+    if (denom > std::numeric_limits<SolveScalar>::min ()) {
+      x *= err.dot (moved) / denom;
+    } else {
+      x.setZero ();
+    }
+  } else {
+    SolveMatrix6 gram =
+      weights.asDiagonal () * jac.poseGram () * weights.asDiagonal ();
+    SolveVector6 y;
+    if (this->solver == IK_DLS || this->solver == IK_CG
+        || this->solver == IK_LM) {
+      gram.diagonal ().array () += SolveScalar (this->damping * this->damping);
+      y = gram.ldlt ().solve (err);
+    } else {
+      // The eigenvalues are squared singular values of the weighted rows.
+      Eigen::SelfAdjointEigenSolver<SolveMatrix6> eigen (gram);
+      SolveVector6 values = eigen.eigenvalues ();
+      SolveScalar threshold = std::max (
+        values.maxCoeff () * 6 * Eigen::NumTraits<SolveScalar>::epsilon (),
+        std::numeric_limits<SolveScalar>::min ());
+      y = eigen.eigenvectors ().transpose () * err;
+      for (int i = 0; i < 6; i++) {
+        y(i) = values(i) > threshold ? y(i) / values(i) : 0;
+      }
+      y = eigen.eigenvectors () * y;
+    }
+    jac.poseTransposeTimes (weights.cwiseProduct (y), x);
+  }
+  if (this->limited) {
+    applyLimits (jac, err.template head<3>(), x, 0);
+  }
+};
+
+// Steps towards goal until the tip is within tolerance of it, maxIters
+// steps have been taken, or the next step would take the total time past
+// timeBudget seconds (0 for no limit). An arm with no joints takes no
+// steps.
+template <int N, typename Scalar, typename SolveScalar>
+IKResult BasicArm<N, Scalar, SolveScalar>::solve (Vector3 goal,
+                                                  float tolerance,
+                                                  int maxIters,
+                                                  double timeBudget) {
+  int length = this->joints.cols () - 1;
+  return iterate ([&] () { stepTowards (goal); },
+                  [&] () { return (goal - this->joints.col (length)).norm (); },
+                  tolerance, maxIters, timeBudget);
+};
+
+// The same for a pose goal, until its weighted error (see poseError) is
+// within tolerance.
+template <int N, typename Scalar, typename SolveScalar>
+IKResult BasicArm<N, Scalar, SolveScalar>::solve (Vector3 goal,
+                                                  const Matrix3& orientation,
+                                                  float tolerance,
+                                                  int maxIters,
+                                                  double timeBudget,
+                                                  const PoseWeights& weights) {
+  return iterate ([&] () { stepTowards (goal, orientation, weights); },
+                  [&] () {
+                    return poseError (goal, orientation, weights).norm ();
+                  },
+                  tolerance, maxIters, timeBudget);
+};
+
+// Calls step until error () is within tolerance, or maxIters steps or the
+// time budget run out. The next step's cost is estimated as the mean so
+// far, so the budget is respected rather than overrun by up to a step.
+template <int N, typename Scalar, typename SolveScalar>
+template <typename Step, typename Error>
+IKResult BasicArm<N, Scalar, SolveScalar>::iterate (Step step, Error error,
+                                                    float tolerance,
+                                                    int maxIters,
+                                                    double timeBudget) {
+  typedef std::chrono::steady_clock clock;
+  clock::time_point start = clock::now ();
+  IKResult result;
+  result.iterations = 0;
+  result.status = IK_MAX_ITERATIONS;
+  result.error = error ();
+  // Without joints a step changes nothing, so don't spend the budget.
+  if (result.error > tolerance && this->added == 1) {
+    result.status = IK_NO_JOINTS;
+    return result;
+  }
+  while (result.error > tolerance) {
+    if (result.iterations >= maxIters) return result;
+    if (timeBudget > 0 && result.iterations > 0) {
+      double elapsed =
+        std::chrono::duration<double> (clock::now () - start).count ();
+      if (elapsed + elapsed / result.iterations > timeBudget) {
+        result.status = IK_TIME_BUDGET;
+        return result;
+      }
+    }
+    step ();
+    result.iterations++;
+    result.error = error ();
+  }
+  result.status = IK_CONVERGED;
+  return result;
+};
+
+// Computes the SVD of the jacobian as U S (Q W)^T, starting from J^T in
+// the q workspace and leaving Q there, or returns the cached one. A
+// JacobiSVD of the 3 x 3N jacobian allocates inside its QR
+// preconditioner, so do that step here: take a thin QR of the transpose,
+// jacobian^T = Q R, by Gram-Schmidt (run twice to keep Q orthogonal in
+// float). Then jacobian = R^T Q^T, and R^T = U S W^T is only 3x3.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::factor (SolveMatrix3& u,
+                                               SolveVector3& sv,
+                                               SolveMatrix3& w) {
+  if (this->cache.valid) {
+    u = this->cache.u;
+    sv = this->cache.sv;
+    w = this->cache.w;
+    return;
+  }
+  SolveScalar scale = this->q.colwise ().norm ().maxCoeff ();
+  SolveMatrix3 r = SolveMatrix3::Zero ();
+  for (int k = 0; k < 3; k++) {
+    for (int pass = 0; pass < 2; pass++) {
+      for (int j = 0; j < k; j++) {
+        SolveScalar d = this->q.col (j).dot (this->q.col (k));
+        r(j,k) += d;
+        this->q.col (k) -= d * this->q.col (j);
+      }
+    }
+    r(k,k) = this->q.col (k).norm ();
+    // A vanishing column means the jacobian is rank deficient.
+    if (r(k,k) > scale * Eigen::NumTraits<SolveScalar>::epsilon ()) {
+      this->q.col (k) /= r(k,k);
+    } else {
+      r(k,k) = 0;
+      this->q.col (k).setZero ();
+    }
+  }
+  Eigen::JacobiSVD<SolveMatrix3> svd (r.transpose (),
+    Eigen::ComputeFullU | Eigen::ComputeFullV);
+  u = this->cache.u = svd.matrixU ();
+  sv = this->cache.sv = svd.singularValues ();
+  w = this->cache.w = svd.matrixV ();
+  this->cache.valid = true;
+};
+
+// Pseudo-inverse solution, x = Q W S^-1 U^T err, dropping singular values
+// below the same threshold JacobiSVD::solve uses.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::solveSVD (const Jacobian&,
+                                                 const SolveVector3& err,
+                                                 SolveVectorRef x) {
+  SolveMatrix3 u, w;
+  SolveVector3 sv;
+  factor (u, sv, w);
+  SolveScalar threshold =
+    std::max (sv(0) * 3 * Eigen::NumTraits<SolveScalar>::epsilon (),
+              std::numeric_limits<SolveScalar>::min ());
+  SolveVector3 y = u.transpose () * err;
+  for (int i = 0; i < 3; i++) {
+    y(i) = sv(i) > threshold ? y(i) / sv(i) : 0;
+  }
+  x.noalias () = this->q.topRows (x.size ()) * (w * y);
+};
+
+// Damped least squares. The normal equations are only 3x3, so the
+// factorization is constant cost and the O(N) work is two mat-vecs. The
+// damped gram is kept for addNullspace.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::solveDLS (const Jacobian& jac,
+                                                 const SolveVector3& err,
+                                                 SolveVectorRef x) {
+  SolveMatrix3& jjt = this->dampedGram;
+  jjt = jac.gram ();
+  jjt.diagonal ().array () += SolveScalar (this->damping * this->damping);
+  jac.transposeTimes (jjt.ldlt ().solve (err), x);
+};
+
+// Selectively damped least squares: each singular direction gets its own
+// bound on how far it may rotate the joints, based on how much a unit
+// move along it would move the tip. See Buss and Kim, "Selectively
+// damped least squares for inverse kinematics" (2005).
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::solveSDLS (const Jacobian& jac,
+                                                  const SolveVector3& err,
+                                                  SolveVectorRef x) {
+  const SolveScalar maxAngle = SDLS_MAX_ANGLE;
+  SolveMatrix3 u, w;
+  SolveVector3 sv;
+  factor (u, sv, w);
+  SolveScalar threshold =
+    std::max (sv(0) * 3 * Eigen::NumTraits<SolveScalar>::epsilon (),
+              std::numeric_limits<SolveScalar>::min ());
+  int dofs = jac.cols ();
+  // Accumulate the clamped per-direction steps as coefficients of Q.
+  SolveVector3 y = SolveVector3::Zero ();
+  for (int i = 0; i < 3; i++) {
+    if (sv(i) <= threshold) continue;
+    // v_i = Q w_i is the i-th right singular vector. M_i bounds how much
+    // the tip moves per unit move along v_i.
+    SolveScalar m = 0, maxV = 0;
+    for (int j = 0; j < dofs; j++) {
+      SolveScalar v = std::fabs (this->q.row (j).dot (w.col (i)));
+      m += v * jac.colNorm (j);
+      maxV = std::max (maxV, v);
+    }
+    m /= sv(i);
+    SolveScalar gamma = std::min (SolveScalar (1), 1 / m) * maxAngle;
+    // Step along v_i, clamped so no joint rotates more than gamma.
+    SolveScalar c = u.col (i).dot (err) / sv(i);
+    SolveScalar largest = std::fabs (c) * maxV;
+    if (largest > gamma) c *= gamma / largest;
+    y += c * w.col (i);
+  }
+  x.noalias () = this->q.topRows (x.size ()) * y;
+  // Clamp the total step too.
+  SolveScalar largest = x.cwiseAbs ().maxCoeff ();
+  if (largest > maxAngle) x *= maxAngle / largest;
+};
+
+// Jacobian transpose, x = alpha J^T err, with alpha chosen so J x is as
+// close to err as possible along that direction.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::solveTranspose (
+  const Jacobian& jac, const SolveVector3& err, SolveVectorRef x) {
+  jac.transposeTimes (err, x);
+  SolveVector3 jjtErr = jac * x;
+  SolveScalar denom = jjtErr.dot (jjtErr);
+  if (denom > std::numeric_limits<SolveScalar>::min ()) {
+    x *= err.dot (jjtErr) / denom;
+  } else {
+    x.setZero ();
+  }
+};
+
+// Damped least squares in joint space by conjugate gradients; see
+// solveNormalCG. x still holds the previous step's solution, which is the
+// warm start: the goal moves little between steps, so CG starts close.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::solveCG (const Jacobian& jac,
+                                                const SolveVector3& err,
+                                                SolveVectorRef x) {
+  solveNormalCG (jac, SolveScalar (this->damping), err,
+                 SolveVectorRef (this->rhs.head (x.size ())), x);
+};
+
+// Keeps the step x inside the joint limits, by clamping and re-solving.
+// The bounds are on each joint's rotation about its own axes, where they
+// are a box. With ball joints alone x is on the world axes, so it is
+// first turned into each parent's axes, and J written out for those axes
+// into localJac. Any coordinate outside
+// the box is clamped to it and fixed there, and the free ones are
+// re-solved by damped least squares for what the fixed ones leave of
+// err. That is repeated until nothing moves out of the box, up to passes
+// times, so each pass is one more 3x3 solve and O(N); with no passes x
+// is only clamped. The
+// bounds treat rotations as adding, which is right to first order in the
+// step; a joint that overshoots is pulled back by the next step's bounds.
+template <int N, typename Scalar, typename SolveScalar>
+void BasicArm<N, Scalar, SolveScalar>::applyLimits (const Jacobian& jac,
+                                                    const SolveVector3& err,
+                                                    SolveVectorRef x,
+                                                    int passes) {
+  int length = this->joints.cols () - 1;
+  int dofs = jac.cols ();
+  // x is scaled by STEP_SIZE when applied (see rodriguez).
+  const Scalar step = STEP_SIZE;
+  for (int i = 0; i < length; i++) {
+    int begin = this->reduced ? this->firstDof (i) : 3 * i;
+    int end = this->reduced ? this->firstDof (i + 1) : 3 * i + 3;
+    Vector3 angle = jointRotation (i);
+    for (int j = begin; j < end; j++) {
+      // How far the joint is turned about this axis.
+      int k = j - begin;
+      Scalar turned = this->reduced ?
+        this->localAxes.col (j).dot (angle) : angle(k);
+      this->box(j,0) = SolveScalar ((this->lower(k,i) - turned) / step);
+      this->box(j,1) = SolveScalar ((this->upper(k,i) - turned) / step);
+    }
+    // A reduced arm's jacobianOperator has already written localJac.
+    if (!this->reduced) {
+      SolveMatrix3 parent = parentRotation (i).template cast<SolveScalar> ();
+      x.template segment<3>(3*i) =
+        parent.transpose () * x.template segment<3>(3*i);
+      this->localJac.template block<3,3>(0,3*i) =
+        crossmat (jac.lever (i)) * parent;
+    }
+  }
+  for (int pass = 0; pass < passes; pass++) {
+    // Clamp and fix. A fixed coordinate has equal bounds.
+    bool clamped = false;
+    for (int j = 0; j < dofs; j++) {
+      if (x(j) >= this->box(j,0) && x(j) <= this->box(j,1)) continue;
+      x(j) = std::min (std::max (x(j), this->box(j,0)), this->box(j,1));
+      this->box(j,0) = this->box(j,1) = x(j);
+      clamped = true;
+    }
+    if (!clamped) break;
+    SolveVector3 residual = err;
+    SolveMatrix3 gram = SolveMatrix3::Identity () *
+      SolveScalar (this->damping * this->damping);
+    for (int j = 0; j < dofs; j++) {
+      if (this->box(j,0) == this->box(j,1)) {
+        residual -= this->localJac.col (j) * x(j);
+      } else {
+        gram.noalias () += this->localJac.col (j)
+          * this->localJac.col (j).transpose ();
+      }
+    }
+    SolveVector3 f = gram.ldlt ().solve (residual);
+    for (int j = 0; j < dofs; j++) {
+      if (this->box(j,0) != this->box(j,1)) {
+        x(j) = this->localJac.col (j).dot (f);
+      }
+    }
+  }
+  // Clamp whatever the last pass left outside, and turn x back to the
+  // world axes if it came from them.
+  x = x.cwiseMax (this->box.col (0).head (dofs))
+    .cwiseMin (this->box.col (1).head (dofs));
+  if (!this->reduced) {
+    for (int i = 0; i < length; i++) {
+      x.template segment<3>(3*i) = parentRotation (i)
+        .template cast<SolveScalar> () * x.template segment<3>(3*i);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "armlanes.h"
+#include "kinematics.h"
+#include <cassert>
+
+using namespace Eigen;
+using namespace std;
+
+// One value, 3-vector or row-major 3x3 matrix per lane.
+typedef Array<float, LANE_WIDTH, 1> Lane;
+typedef Array<float, LANE_WIDTH, 3> Lane3;
+typedef Array<float, LANE_WIDTH, 9> Lane33;
+
+static Lane3 cross (const Lane3& a, const Lane3& b) {
+  Lane3 c;
+  c.col (0) = a.col (1) * b.col (2) - a.col (2) * b.col (1);
+  c.col (1) = a.col (2) * b.col (0) - a.col (0) * b.col (2);
+  c.col (2) = a.col (0) * b.col (1) - a.col (1) * b.col (0);
+  return c;
+};
+
+// m * v, per lane.
+static Lane3 apply (const Lane33& m, const Lane3& v) {
+  Lane3 r;
+  for (int i = 0; i < 3; i++) {
+    r.col (i) = m.col (3*i) * v.col (0) + m.col (3*i+1) * v.col (1)
+                + m.col (3*i+2) * v.col (2);
+  }
+  return r;
+};
+
+// a * b, per lane.
+static Lane33 compose (const Lane33& a, const Lane33& b) {
+  Lane33 r;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      r.col (3*i+j) = a.col (3*i) * b.col (j) + a.col (3*i+1) * b.col (3+j)
+                      + a.col (3*i+2) * b.col (6+j);
+    }
+  }
+  return r;
+};
+
+// Rotation by the expmap r scaled by STEP_SIZE, per lane. Same rotation
+// as rodriguez() in kinematics.h, written as I + sin K + (1 - cos) K^2.
+static Lane33 rotation (const Lane3& r) {
+  Lane norm = r.square ().rowwise ().sum ().sqrt ();
+  Lane inv = (norm > 0).select (norm.inverse (), Lane::Zero ());
+  Lane3 k = r.colwise () * inv;
+  Lane s = (norm * STEP_SIZE).sin ();
+  Lane c = 1 - (norm * STEP_SIZE).cos ();
+  Lane33 m;
+  m.col (0) = 1 + c * (k.col (0).square () - 1);
+  m.col (1) = c * k.col (0) * k.col (1) - s * k.col (2);
+  m.col (2) = c * k.col (0) * k.col (2) + s * k.col (1);
+  m.col (3) = c * k.col (0) * k.col (1) + s * k.col (2);
+  m.col (4) = 1 + c * (k.col (1).square () - 1);
+  m.col (5) = c * k.col (1) * k.col (2) - s * k.col (0);
+  m.col (6) = c * k.col (0) * k.col (2) - s * k.col (1);
+  m.col (7) = c * k.col (1) * k.col (2) + s * k.col (0);
+  m.col (8) = 1 + c * (k.col (2).square () - 1);
+  return m;
+};
+
+// Lanes are padded up to a whole number of blocks with copies of arm.
+ArmLanes::ArmLanes (int numArms, const Arm& arm)
+  : lanes (numArms), length (arm.numJoints ()), damping (DEFAULT_DAMPING) {
+  int padded = (numArms + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+  this->pos.resize (padded, 3 * this->length);
+  for (int lane = 0; lane < padded; lane++) {
+    this->setArm (lane, arm);
+  }
+};
+
+void ArmLanes::setArm (int lane, const Arm& arm) {
+  assert (arm.numJoints () == this->length);
+  const Matrix3Xf& joints = arm.getJoints ();
+  for (int j = 0; j < this->length; j++) {
+    for (int k = 0; k < 3; k++) {
+      this->pos (lane, 3*j+k) = joints (k, j);
+    }
+  }
+};
+
+void ArmLanes::setDamping (float lambda) {
+  this->damping = lambda;
+};
+
+int ArmLanes::size (void) const {
+  return this->lanes;
+};
+
+int ArmLanes::numJoints (void) const {
+  return this->length;
+};
+
+Matrix3Xf ArmLanes::getJoints (int lane) const {
+  Matrix3Xf joints (3, this->length);
+  for (int j = 0; j < this->length; j++) {
+    for (int k = 0; k < 3; k++) {
+      joints (k, j) = this->pos (lane, 3*j+k);
+    }
+  }
+  return joints;
+};
+
+// Steps arm i towards goals.col (i), for every arm. Blocks are
+// independent, so they are shared out across cores.
+void ArmLanes::stepTowards (const Matrix3Xf& goals) {
+  int blocks = this->pos.rows () / LANE_WIDTH;
+  #pragma omp parallel for
+  for (int b = 0; b < blocks; b++) {
+    stepBlock (b * LANE_WIDTH, goals);
+  }
+};
+
+// One damped least squares step for the LANE_WIDTH arms starting at b.
+// Matches Arm::stepTowards with IK_DLS, up to rounding.
+void ArmLanes::stepBlock (int b, const Matrix3Xf& goals) {
+  int n = this->length - 1;
+  if (n == 0) return;
+
+  // Gather the goals; padding lanes reuse the last real goal.
+  Lane3 goal;
+  for (int l = 0; l < LANE_WIDTH; l++) {
+    int g = min (b + l, this->lanes - 1);
+    goal.row (l) = goals.col (g).transpose ().array ();
+  }
+  Lane3 tip = this->pos.block<LANE_WIDTH,3>(b, 3*n);
+  Lane3 err = goal - tip;
+
+  // J J^T = sum over joints of |d|^2 I - d d^T, with d = joint - tip.
+  Lane a00 = Lane::Zero (), a11 = Lane::Zero (), a22 = Lane::Zero ();
+  Lane a01 = Lane::Zero (), a02 = Lane::Zero (), a12 = Lane::Zero ();
+  for (int j = 0; j < n; j++) {
+    Lane3 d = this->pos.block<LANE_WIDTH,3>(b, 3*j) - tip;
+    Lane3 d2 = d.square ();
+    a00 += d2.col (1) + d2.col (2);
+    a11 += d2.col (0) + d2.col (2);
+    a22 += d2.col (0) + d2.col (1);
+    a01 -= d.col (0) * d.col (1);
+    a02 -= d.col (0) * d.col (2);
+    a12 -= d.col (1) * d.col (2);
+  }
+  float l2 = this->damping * this->damping;
+  a00 += l2;
+  a11 += l2;
+  a22 += l2;
+
+  // f = (J J^T + lambda^2 I)^-1 err, by the adjugate.
+  Lane c00 = a11 * a22 - a12 * a12;
+  Lane c01 = a02 * a12 - a01 * a22;
+  Lane c02 = a01 * a12 - a02 * a11;
+  Lane c11 = a00 * a22 - a02 * a02;
+  Lane c12 = a01 * a02 - a00 * a12;
+  Lane c22 = a00 * a11 - a01 * a01;
+  Lane invDet = (a00 * c00 + a01 * c01 + a02 * c02).inverse ();
+  Lane3 f;
+  f.col (0) = (c00 * err.col (0) + c01 * err.col (1) + c02 * err.col (2))
+              * invDet;
+  f.col (1) = (c01 * err.col (0) + c11 * err.col (1) + c12 * err.col (2))
+              * invDet;
+  f.col (2) = (c02 * err.col (0) + c12 * err.col (1) + c22 * err.col (2))
+              * invDet;
+
+  // Forward kinematics, composing the step's rotations into the positions
+  // in place. Unlike Arm, lanes keep no rest pose, so long runs slowly
+  // drift. The accumulated transform is x -> R x + t, and joint j's
+  // expmap is J_j^T f = f x d.
+  Lane33 r = Lane33::Zero ();
+  r.col (0) = r.col (4) = r.col (8) = Lane::Ones ();
+  Lane3 t = Lane3::Zero ();
+  for (int j = 0; j < n; j++) {
+    Lane3 joint = this->pos.block<LANE_WIDTH,3>(b, 3*j);
+    this->pos.block<LANE_WIDTH,3>(b, 3*j) = apply (r, joint) + t;
+    // Rotating about the joint: x -> joint + Q (x - joint).
+    Lane33 q = rotation (cross (f, joint - tip));
+    t += apply (r, joint - apply (q, joint));
+    r = compose (r, q);
+  }
+  this->pos.block<LANE_WIDTH,3>(b, 3*n) = apply (r, tip) + t;
+};
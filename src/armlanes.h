@@ -0,0 +1,40 @@
+#ifndef ARMLANES_H
+#define ARMLANES_H
+
+#include "arm.h"
+
+// Arms per block in the lanes kernel. 8 floats is one AVX register or
+// two SSE registers.
+#define LANE_WIDTH 8
+
+// Many arms with the same number of joints, laid out with one arm per
+// SIMD lane. Joint coordinates are stored structure-of-arrays: column
+// 3j+k of the position array holds coordinate k of joint j for every arm,
+// so each step streams through contiguous runs of lanes.
+//
+// The step is damped least squares, which for a single ball-joint chain
+// reduces to closed-form per-lane math: J J^T is a sum of 3x3 terms, and
+// J^T f for joint j is f x (joint j - tip). Eigen's packet math vectorizes
+// each block of LANE_WIDTH arms, and falls back to scalar code when
+// vectorization is off (e.g. with EIGEN_DONT_VECTORIZE). Every joint is
+// stepped as a ball joint, whatever axes or limits the Arm it was copied
+// from gave it.
+
+class ArmLanes {
+  private:
+    int lanes;
+    int length;
+    float damping;
+    Eigen::ArrayXXf pos;
+    void stepBlock (int b, const Eigen::Matrix3Xf& goals);
+  public:
+    ArmLanes (int numArms, const Arm& arm);
+    void setArm (int lane, const Arm& arm);
+    void setDamping (float lambda);
+    void stepTowards (const Eigen::Matrix3Xf& goals);
+    int size (void) const;
+    int numJoints (void) const;
+    Eigen::Matrix3Xf getJoints (int lane) const;
+};
+
+#endif
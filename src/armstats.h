@@ -0,0 +1,46 @@
+#ifndef ARMSTATS_H
+#define ARMSTATS_H
+
+// Per-stage solver timings, in seconds, accumulated by Arm::stepTowards
+// when built with ARM_STATS defined. Without it the instrumentation
+// compiles away and the stats stay zero.
+
+struct ArmStats {
+  long steps;
+  long reuses;       // Steps that reused the last factorization.
+  double jacobian;   // Writing out J^T for the SVD solvers.
+  double solve;      // Solving for the joint rotations.
+  double rotate;     // Forward kinematics in applyRotations.
+  ArmStats (void) : steps (0), reuses (0), jacobian (0), solve (0), rotate (0) {};
+};
+
+#ifdef ARM_STATS
+
+#include <chrono>
+
+// Adds the time until the end of the enclosing scope to total.
+class ScopedTimer {
+  private:
+    double& total;
+    std::chrono::steady_clock::time_point start;
+  public:
+    ScopedTimer (double& total)
+      : total (total), start (std::chrono::steady_clock::now ()) {};
+    ~ScopedTimer (void) {
+      std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now () - this->start;
+      this->total += elapsed.count ();
+    };
+};
+
+#define ARM_TIME_SCOPE(total) ScopedTimer scopedTimer (total)
+#define ARM_COUNT(counter) ((counter)++)
+
+#else
+
+#define ARM_TIME_SCOPE(total)
+#define ARM_COUNT(counter)
+
+#endif
+
+#endif
@@ -0,0 +1,833 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#include "arm.h"
+#include "kinematics.h"
+#include "skeleton.h"
+
+using namespace std;
+using namespace Eigen;
+
+/*
+Micro-benchmarks for the arm kinematics. Reports ns per call and heap
+allocations per call for
+
+- the primitives in kinematics.h and the 4x4 transforms they replaced,
+- Arm::jacobian, Arm::applyRotations and Arm::stepTowards (every solver)
+  for chains of 4, 8, ... up to maxJoints joints. ns/joint shows how each
+  scales with chain length,
+- Arm::applyRotations against the 4x4 homogeneous path it replaced,
+  composing transforms into the positions in place,
+- Arm::stepTowards against BasicArm<N> with the joint count fixed at
+  compile time,
+- Arm, Armd and ArmMixed: ns per step against how far the link lengths
+  drift from their rest lengths over a long run,
+- Arm::stepTowards with and without joint limits, and how far the
+  limited joints end up outside their limits,
+- Arm::stepTowards on chains of ball joints against chains of hinges,
+- Skeleton::stepTowards on a branching figure with five effectors,
+  against the same step taken with a dense jacobian (and how far apart
+  the two leave the points), after checking that a skeleton with one
+  chain steps like an Arm,
+- Arm::stepTowards with a pose goal against a position goal, and how
+  many steps each solver takes to reach a pose,
+- Arm::solve with cyclic coordinate descent, FABRIK and
+  Levenberg-Marquardt against the jacobian solvers: time and steps to
+  reach each goal, and how far FABRIK leaves the link lengths from their
+  rest lengths,
+- Arm::stepTowards with nullspace objectives: what each does to the
+  pose the arm settles in, and what they cost per step.
+
+Usage: bench_arm [-m maxJoints] [-t seconds] [section]
+  -m maxJoints   Longest chain to time (default 1024).
+  -t seconds     Minimum time per measurement (default .1).
+  section        Only run primitives, arm, fk, fixed, precision,
+                 limits, hinges, skeleton, pose, solve or nullspace.
+*/
+
+// Counts heap allocations. Eigen allocates with malloc directly, so hook
+// that rather than operator new. Only done where glibc makes it easy.
+#ifdef __GLIBC__
+#define COUNT_ALLOCATIONS
+static long allocations = 0;
+extern "C" void *__libc_malloc (size_t size);
+extern "C" void *__libc_realloc (void *ptr, size_t size);
+extern "C" void *malloc (size_t size) {
+  allocations++;
+  return __libc_malloc (size);
+}
+extern "C" void *realloc (void *ptr, size_t size) {
+  allocations++;
+  return __libc_realloc (ptr, size);
+}
+#else
+static long allocations = 0;
+#endif
+
+static double minTime = .1;
+
+// Keeps results alive so the optimizer can't drop the work.
+static volatile float sink;
+
+struct Timing {
+  double ns;      // Per call.
+  double allocs;  // Per call.
+};
+
+// Runs f until at least minTime seconds have passed.
+template <typename F>
+static Timing timeCalls (F f) {
+  f ();
+  long reps = 1;
+  while (true) {
+    long before = allocations;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now ();
+    for (long r = 0; r < reps; r++) f ();
+    chrono::duration<double> elapsed = chrono::steady_clock::now () - start;
+    if (elapsed.count () > minTime) {
+      Timing t;
+      t.ns = elapsed.count () * 1e9 / reps;
+      t.allocs = (double) (allocations - before) / reps;
+      return t;
+    }
+    reps *= 2;
+  }
+}
+
+static void printAllocs (double allocs) {
+#ifdef COUNT_ALLOCATIONS
+  cout << allocs;
+#else
+  cout << "n/a";
+#endif
+}
+
+static void printRow (const string& name, const Timing& t) {
+  cout << name << "\t" << t.ns << "\t";
+  printAllocs (t.allocs);
+  cout << endl;
+}
+
+// Builds a straight arm along x with the given number of rotating joints.
+static Arm makeArm (int length, IKSolver solver) {
+  Arm arm;
+  arm.setSolver (solver);
+  for (int i = 1; i <= length; i++) arm.addJoint (4.f * i / length, 0, 0);
+  return arm;
+}
+
+//****************************************************
+// 4x4 homogeneous transforms
+//****************************************************
+
+// The solvers compose plain rotations and offsets instead; these are kept
+// for the reference path the forward kinematics are checked against.
+static Matrix4f homogeneous (const Matrix3f& r) {
+  Matrix4f m = Matrix4f::Identity ();
+  m.block<3,3>(0,0) = r;
+  return m;
+}
+
+static Matrix4f translation (const Vector3f& v) {
+  Matrix4f m = Matrix4f::Identity ();
+  m.block<3,1>(0,3) = v;
+  return m;
+}
+
+static Vector3f applyTransform (const Matrix4f& t, const Vector3f& v3) {
+  Vector4f v4;
+  v4 << v3, 1;
+  v4 = t * v4;
+  return v4.head (3) / v4(3);
+}
+
+//****************************************************
+// Primitives
+//****************************************************
+static void benchPrimitives (void) {
+  const int count = 1024;
+  Matrix3Xf vs = Matrix3Xf::Random (3, count);
+  Matrix4f t = translation (Vector3f (1, 2, 3)) *
+               homogeneous (rodriguez (Vector3f (1, 1, 0)));
+  // Expmaps that turn less than the Taylor threshold per step.
+  Matrix3Xf small = vs * .1f;
+  Matrix3Xf turns (3, 3 * count);
+  int i = 0;
+
+  cout << "Primitives" << endl;
+  cout << "op\tns/op\tallocs/op" << endl;
+  printRow ("crossmat", timeCalls ([&] () {
+    sink = crossmat (vs.col (i++ % count)).sum ();
+  }));
+  printRow ("rodriguez", timeCalls ([&] () {
+    sink = rodriguez (vs.col (i++ % count)).sum ();
+  }));
+  printRow ("rodriguez small", timeCalls ([&] () {
+    sink = rodriguez (small.col (i++ % count)).sum ();
+  }));
+  // Per column, over all of them at once.
+  Timing batch = timeCalls ([&] () {
+    rodriguezBatch (vs, turns);
+    sink = turns (0, 0);
+  });
+  batch.ns /= count;
+  batch.allocs /= count;
+  printRow ("rodriguezBatch", batch);
+  printRow ("translation", timeCalls ([&] () {
+    sink = translation (vs.col (i++ % count)).sum ();
+  }));
+  printRow ("applyTransform", timeCalls ([&] () {
+    sink = applyTransform (t, vs.col (i++ % count)).sum ();
+  }));
+  // The batch must match the single rotations, including a zero one.
+  vs.col (0).setZero ();
+  rodriguezBatch (vs, turns);
+  float diff = 0;
+  for (int c = 0; c < count; c++) {
+    diff = max (diff, (turns.block<3,3>(0,3*c) - rodriguez (vs.col (c)))
+                .cwiseAbs ().maxCoeff ());
+  }
+  cout << "rodriguezBatch within " << diff << " of rodriguez; zero expmap "
+       << (turns.block<3,3>(0,0).isIdentity (0) ? "is" : "is not")
+       << " the identity" << endl;
+  cout << endl;
+}
+
+//****************************************************
+// Per-arm operations, swept over chain length
+//****************************************************
+static void printHeader (const string& name) {
+  cout << name << endl;
+  cout << "joints\tns/op\tns/joint\tx prev\tallocs/op" << endl;
+}
+
+static void printSweepRow (int length, const Timing& t, double& prev) {
+  cout << length << "\t" << t.ns << "\t" << t.ns / length << "\t";
+  if (prev > 0) cout << t.ns / prev;
+  else cout << "-";
+  cout << "\t";
+  printAllocs (t.allocs);
+  cout << endl;
+  prev = t.ns;
+}
+
+static void benchArm (int maxJoints) {
+  double prev = 0;
+  printHeader ("Arm::jacobian");
+  for (int length = 4; length <= maxJoints; length *= 2) {
+    Arm arm = makeArm (length, IK_SVD);
+    printSweepRow (length, timeCalls ([&] () {
+      sink = arm.jacobian () (0, 0);
+    }), prev);
+  }
+  cout << endl;
+
+  prev = 0;
+  printHeader ("Arm::applyRotations");
+  for (int length = 4; length <= maxJoints; length *= 2) {
+    Arm arm = makeArm (length, IK_SVD);
+    // Rotations that cancel over two calls keep the arm in range.
+    Matrix3Xf expmaps = Matrix3Xf::Random (3, length);
+    Matrix3Xf back = -expmaps;
+    bool flip = false;
+    printSweepRow (length, timeCalls ([&] () {
+      arm.applyRotations ((flip = !flip) ? expmaps : back);
+    }), prev);
+  }
+  cout << endl;
+
+  const char *names[] = {"svd", "dls", "sdls", "transpose", "cg", "ccd",
+                         "fabrik", "lm"};
+  IKSolver solvers[] = {IK_SVD, IK_DLS, IK_SDLS, IK_TRANSPOSE, IK_CG,
+                        IK_CCD, IK_FABRIK, IK_LM};
+  for (int s = 0; s < 8; s++) {
+    prev = 0;
+    printHeader (string ("Arm::stepTowards (") + names[s] + ")");
+    for (int length = 4; length <= maxJoints; length *= 2) {
+      Arm arm = makeArm (length, solvers[s]);
+      // Alternate goals so the arm keeps moving.
+      Vector3f goals[] = {Vector3f (1, 2, 1), Vector3f (-1, 1, 2)};
+      int step = 0;
+      printSweepRow (length, timeCalls ([&] () {
+        arm.stepTowards (goals[(step++ / 16) % 2]);
+      }), prev);
+    }
+    cout << endl;
+  }
+}
+
+//****************************************************
+// Forward kinematics against the old 4x4 path
+//****************************************************
+
+// The old applyRotations, with every joint rotation as a 4x4 transform.
+static void applyRotations4x4 (Matrix3Xf& joints, const Matrix3Xf& expmaps) {
+  int length = joints.cols () - 1;
+  Matrix4f transform = Matrix4f::Identity ();
+  for (int i = 0; i < length; i++) {
+    Vector3f joint = joints.col (i);
+    joints.col (i) = applyTransform (transform, joint);
+    transform *= translation (joint) * homogeneous (rodriguez (expmaps.col (i)))
+      * translation (-joint);
+  }
+  joints.col (length) = applyTransform (transform, joints.col (length));
+}
+
+static void benchForwardKinematics (int maxJoints) {
+  cout << "Forward kinematics (ns/joint)" << endl;
+  cout << "joints\t4x4\tarm\tspeedup\tmax diff" << endl;
+  for (int length = 4; length <= maxJoints; length *= 4) {
+    Arm arm = makeArm (length, IK_SVD);
+    Matrix3Xf expmaps = Matrix3Xf::Random (3, length);
+    Matrix3Xf back = -expmaps;
+
+    // Check both paths agree before timing them.
+    Matrix3Xf joints = arm.getJoints ();
+    applyRotations4x4 (joints, expmaps);
+    arm.applyRotations (expmaps);
+    float diff = (joints - arm.getJoints ()).cwiseAbs ().maxCoeff ();
+
+    double old = timeCalls ([&] () {
+      applyRotations4x4 (joints, expmaps);
+      applyRotations4x4 (joints, back);
+    }).ns / (2 * length);
+    double current = timeCalls ([&] () {
+      arm.applyRotations (expmaps);
+      arm.applyRotations (back);
+    }).ns / (2 * length);
+    cout << length << "\t" << old << "\t" << current << "\t"
+         << old / current << "\t" << diff << endl;
+  }
+  cout << endl;
+}
+
+//****************************************************
+// Fixed-size arms against Arm
+//****************************************************
+
+// Steps the same arm as an Arm and as a BasicArm<N>, checks they end up
+// in the same place, then times a step of each.
+template <int N>
+static void benchFixedLength (IKSolver solver) {
+  Arm arm = makeArm (N, solver);
+  BasicArm<N> fixed;
+  fixed.setSolver (solver);
+  for (int i = 1; i <= N; i++) fixed.addJoint (4.f * i / N, 0, 0);
+
+  Vector3f goals[] = {Vector3f (1, 2, 1), Vector3f (-1, 1, 2)};
+  for (int step = 0; step < 100; step++) {
+    arm.stepTowards (goals[(step / 16) % 2]);
+    fixed.stepTowards (goals[(step / 16) % 2]);
+  }
+  float diff = (arm.getJoints () - fixed.getJoints ()).cwiseAbs ().maxCoeff ();
+
+  int step = 0;
+  Timing dynamic = timeCalls ([&] () {
+    arm.stepTowards (goals[(step++ / 16) % 2]);
+  });
+  step = 0;
+  Timing fixedSize = timeCalls ([&] () {
+    fixed.stepTowards (goals[(step++ / 16) % 2]);
+  });
+  cout << N << "\t" << dynamic.ns << "\t" << fixedSize.ns << "\t"
+       << dynamic.ns / fixedSize.ns << "\t";
+  printAllocs (fixedSize.allocs);
+  cout << "\t" << diff << endl;
+}
+
+static void benchFixed (void) {
+  const char *names[] = {"svd", "dls"};
+  IKSolver solvers[] = {IK_SVD, IK_DLS};
+  for (int s = 0; s < 2; s++) {
+    cout << "Arm vs BasicArm<N>::stepTowards (" << names[s] << ", ns/op)"
+         << endl;
+    cout << "joints\tArm\tfixed\tspeedup\tallocs/op\tmax diff" << endl;
+    benchFixedLength<2> (solvers[s]);
+    benchFixedLength<4> (solvers[s]);
+    benchFixedLength<8> (solvers[s]);
+    benchFixedLength<16> (solvers[s]);
+    cout << endl;
+  }
+}
+
+//****************************************************
+// Float, double and mixed precision
+//****************************************************
+
+// Largest change in any link length, relative to the link, after steps
+// steps between two goals. Rotations keep lengths, so this is all
+// rounding error picked up by applyRotations.
+template <typename ArmType>
+static double linkDrift (ArmType& arm, int steps) {
+  typedef typename ArmType::Vector3 Vector3;
+  typename ArmType::JointMatrix rest = arm.getJoints ();
+  Vector3 goals[] = {Vector3 (1, 2, 1), Vector3 (-1, 1, 2)};
+  for (int step = 0; step < steps; step++) {
+    arm.stepTowards (goals[(step / 16) % 2]);
+  }
+  const typename ArmType::JointMatrix& joints = arm.getJoints ();
+  double drift = 0;
+  for (int i = 1; i < joints.cols (); i++) {
+    double before = (rest.col (i) - rest.col (i - 1)).norm ();
+    double after = (joints.col (i) - joints.col (i - 1)).norm ();
+    drift = max (drift, abs (after - before) / before);
+  }
+  return drift;
+}
+
+template <typename ArmType>
+static void benchPrecisionRow (const string& name, int length, int steps) {
+  ArmType arm;
+  arm.setSolver (IK_DLS);
+  for (int i = 1; i <= length; i++) arm.addJoint (4. * i / length, 0, 0);
+  double drift = linkDrift (arm, steps);
+
+  typedef typename ArmType::Vector3 Vector3;
+  Vector3 goals[] = {Vector3 (1, 2, 1), Vector3 (-1, 1, 2)};
+  int step = 0;
+  Timing t = timeCalls ([&] () {
+    arm.stepTowards (goals[(step++ / 16) % 2]);
+  });
+  cout << length << "\t" << name << "\t" << t.ns << "\t" << drift << endl;
+}
+
+static void benchPrecision (int maxJoints) {
+  const int steps = 10000;
+  cout << "Arm precision (dls, link drift after " << steps << " steps)"
+       << endl;
+  cout << "joints\tarm\tns/op\tmax drift" << endl;
+  for (int length = 16; length <= maxJoints; length *= 4) {
+    benchPrecisionRow<Arm> ("float", length, steps);
+    benchPrecisionRow<Armd> ("double", length, steps);
+    benchPrecisionRow<ArmMixed> ("mixed", length, steps);
+  }
+  cout << endl;
+}
+
+//****************************************************
+// Joint limits
+//****************************************************
+
+// Every joint limited to .3 radians about x and y, with z locked.
+static Arm makeLimitedArm (int length, IKSolver solver) {
+  JointLimits limits (Vector3f (-.3, -.3, 0), Vector3f (.3, .3, 0));
+  Arm arm;
+  arm.setSolver (solver);
+  for (int i = 1; i <= length; i++) {
+    arm.addJoint (4.f * i / length, 0, 0, limits);
+  }
+  return arm;
+}
+
+static void benchLimits (int maxJoints) {
+  const char *names[] = {"svd", "dls", "cg"};
+  IKSolver solvers[] = {IK_SVD, IK_DLS, IK_CG};
+  Vector3f goals[] = {Vector3f (1, 2, 1), Vector3f (-1, 1, 2)};
+  for (int s = 0; s < 3; s++) {
+    cout << "Arm::stepTowards with limits (" << names[s] << ", ns/op)"
+         << endl;
+    cout << "joints	free	limited	x free	max violation" << endl;
+    for (int length = 4; length <= maxJoints; length *= 4) {
+      Arm free = makeArm (length, solvers[s]);
+      Arm limited = makeLimitedArm (length, solvers[s]);
+      // Step into the limits, then see how far past them the arm got.
+      for (int step = 0; step < 1000; step++) {
+        limited.stepTowards (goals[(step / 16) % 2]);
+      }
+      float violation = 0;
+      for (int i = 0; i < length; i++) {
+        Vector3f angle = limited.jointRotation (i);
+        Vector3f over = (angle - Vector3f (.3, .3, 0)).cwiseMax (
+          Vector3f (-.3, -.3, 0) - angle);
+        violation = max (violation, over.maxCoeff ());
+      }
+
+      int step = 0;
+      double freeNs = timeCalls ([&] () {
+        free.stepTowards (goals[(step++ / 16) % 2]);
+      }).ns;
+      step = 0;
+      double limitedNs = timeCalls ([&] () {
+        limited.stepTowards (goals[(step++ / 16) % 2]);
+      }).ns;
+      cout << length << "\t" << freeNs << "\t" << limitedNs << "\t"
+           << limitedNs / freeNs << "\t" << max (violation, 0.f) << endl;
+    }
+    cout << endl;
+  }
+}
+
+//****************************************************
+// Hinges against ball joints
+//****************************************************
+
+// Hinges alternating between the z and y axes, so the tip can still
+// reach out of any plane.
+static Arm makeHingeArm (int length, IKSolver solver) {
+  Arm arm;
+  arm.setSolver (solver);
+  for (int i = 1; i <= length; i++) {
+    Vector3f axis = i % 2 ? Vector3f (0, 0, 1) : Vector3f (0, 1, 0);
+    arm.addJoint (4.f * i / length, 0, 0, JointAxes (axis));
+  }
+  return arm;
+}
+
+static void benchHinges (int maxJoints) {
+  const char *names[] = {"svd", "dls", "cg"};
+  IKSolver solvers[] = {IK_SVD, IK_DLS, IK_CG};
+  Vector3f goals[] = {Vector3f (1, 2, 1), Vector3f (-1, 1, 2)};
+  for (int s = 0; s < 3; s++) {
+    cout << "Arm::stepTowards, ball joints vs hinges (" << names[s]
+         << ", ns/op)" << endl;
+    cout << "joints\tball\thinge\tspeedup\tallocs/op" << endl;
+    for (int length = 4; length <= maxJoints; length *= 4) {
+      Arm ball = makeArm (length, solvers[s]);
+      Arm hinge = makeHingeArm (length, solvers[s]);
+      int step = 0;
+      double ballNs = timeCalls ([&] () {
+        ball.stepTowards (goals[(step++ / 16) % 2]);
+      }).ns;
+      step = 0;
+      Timing hingeTime = timeCalls ([&] () {
+        hinge.stepTowards (goals[(step++ / 16) % 2]);
+      });
+      cout << length << "\t" << ballNs << "\t" << hingeTime.ns << "\t"
+           << ballNs / hingeTime.ns << "\t";
+      printAllocs (hingeTime.allocs);
+      cout << endl;
+    }
+    cout << endl;
+  }
+}
+
+//****************************************************
+// Skeletons
+//****************************************************
+
+// Adds a chain of bones from point from to end, and returns its last point.
+static int addLimb (Skeleton& skeleton, int from, const Vector3f& end,
+                    int bones) {
+  Vector3f start = skeleton.getPoints ().col (from);
+  for (int i = 1; i <= bones; i++) {
+    Vector3f point = start + (end - start) * i / bones;
+    from = skeleton.addBone (from, point(0), point(1), point(2));
+  }
+  return from;
+}
+
+// A figure standing on the pelvis: a spine up to the chest, with a neck
+// and head, two arms out sideways and two legs down, each limb the given
+// number of bones. The head, hands and feet are effectors.
+static Skeleton makeFigure (int bones) {
+  Skeleton figure (0, 0, 0);
+  int chest = addLimb (figure, 0, Vector3f (0, 2, 0), bones);
+  figure.addEffector (addLimb (figure, chest, Vector3f (0, 2.6, 0),
+                               max (1, bones / 2)));
+  figure.addEffector (addLimb (figure, chest, Vector3f (2, 2, 0), bones));
+  figure.addEffector (addLimb (figure, chest, Vector3f (-2, 2, 0), bones));
+  figure.addEffector (addLimb (figure, 0, Vector3f (.5, -2.5, 0), bones));
+  figure.addEffector (addLimb (figure, 0, Vector3f (-.5, -2.5, 0), bones));
+  return figure;
+}
+
+// Damped least squares on the figure with J written out densely, the
+// step Skeleton::stepTowards takes through the sparse one.
+struct DenseStep {
+  MatrixXf jac, gram;
+  LDLT<MatrixXf> ldlt;
+  VectorXf err;
+  Matrix3Xf expmaps;
+  void operator() (Skeleton& skeleton, const Matrix3Xf& goals,
+                   const vector<int>& effectors) {
+    this->jac = skeleton.jacobian ();
+    this->err.resize (this->jac.rows ());
+    for (int f = 0; f < (int) effectors.size (); f++) {
+      this->err.segment<3>(3*f) =
+        goals.col (f) - skeleton.getPoints ().col (effectors[f]);
+    }
+    this->gram.noalias () = this->jac * this->jac.transpose ();
+    this->gram.diagonal ().array () += DEFAULT_DAMPING * DEFAULT_DAMPING;
+    this->ldlt.compute (this->gram);
+    this->expmaps.resize (3, skeleton.numJoints ());
+    Map<VectorXf> (this->expmaps.data (), this->expmaps.size ()).noalias ()
+      = this->jac.transpose () * this->ldlt.solve (this->err);
+    skeleton.applyRotations (this->expmaps);
+  };
+};
+
+static void benchSkeleton (int maxJoints) {
+  // A skeleton that is one chain is an Arm, and should step like one.
+  const int chain = 32;
+  Arm arm = makeArm (chain, IK_DLS);
+  Skeleton single (0, 0, 0);
+  single.addEffector (addLimb (single, 0, Vector3f (4, 0, 0), chain));
+  Matrix3Xf goal (3, 1);
+  float apart = 0;
+  for (int step = 0; step < 1000; step++) {
+    goal.col (0) = step / 16 % 2 ? Vector3f (-1, 1, 2) : Vector3f (1, 2, 1);
+    arm.stepTowards (goal.col (0));
+    single.stepTowards (goal);
+    apart = max (apart,
+      (arm.getJoints () - single.getPoints ()).colwise ().norm ().maxCoeff ());
+  }
+  cout << "Skeleton with one chain against Arm (dls): points at most "
+       << apart << " apart over 1000 steps" << endl << endl;
+
+  cout << "Skeleton::stepTowards, 5 effectors (ns/op)" << endl;
+  cout << "joints\tnonzeros\tentries\tsparse\tdense\tspeedup\tapart\t"
+          "allocs/op" << endl;
+  for (int bones = 4; 6 * bones <= maxJoints; bones *= 4) {
+    Skeleton sparse = makeFigure (bones);
+    Skeleton dense = sparse;
+    int effectors = sparse.numEffectors ();
+    vector<int> points;
+    for (int f = 0; f < effectors; f++) points.push_back (sparse.effector (f));
+    // Reach each effector up and forward, then back and down.
+    Matrix3Xf rest (3, effectors), goals[2];
+    for (int f = 0; f < effectors; f++) {
+      rest.col (f) = sparse.getPoints ().col (points[f]);
+    }
+    goals[0] = rest.colwise () + Vector3f (.3, .4, .5);
+    goals[1] = rest.colwise () + Vector3f (-.3, -.2, -.4);
+    // Both step from the same pose. Over many steps they drift apart, as
+    // rounding takes the redundant joints different ways.
+    DenseStep denseStep;
+    float apartFigure = 0;
+    for (int step = 0; step < 200; step++) {
+      dense = sparse;
+      sparse.stepTowards (goals[step / 16 % 2]);
+      denseStep (dense, goals[step / 16 % 2], points);
+      apartFigure = max (apartFigure, (sparse.getPoints ()
+        - dense.getPoints ()).colwise ().norm ().maxCoeff ());
+    }
+
+    int step = 0;
+    Timing sparseTime = timeCalls ([&] () {
+      sparse.stepTowards (goals[step++ / 16 % 2]);
+    });
+    step = 0;
+    double denseNs = timeCalls ([&] () {
+      denseStep (dense, goals[step++ / 16 % 2], points);
+    }).ns;
+    long size = (long) sparse.jacobian ().rows () * sparse.jacobian ().cols ();
+    cout << sparse.numJoints () << "\t" << sparse.jacobian ().nonZeros ()
+         << "\t" << size << "\t" << sparseTime.ns << "\t" << denseNs << "\t"
+         << denseNs / sparseTime.ns << "\t" << apartFigure << "\t";
+    printAllocs (sparseTime.allocs);
+    cout << endl;
+  }
+  cout << endl;
+}
+
+//****************************************************
+// Pose goals
+//****************************************************
+
+static void benchPose (int maxJoints) {
+  const char *names[] = {"svd", "dls", "sdls", "transpose", "cg"};
+  IKSolver solvers[] = {IK_SVD, IK_DLS, IK_SDLS, IK_TRANSPOSE, IK_CG};
+  Vector3f goals[] = {Vector3f (1, 2, 1), Vector3f (-1, 1, 2)};
+  Matrix3f turns[] = {
+    AngleAxisf (.5, Vector3f (0, 0, 1)).toRotationMatrix (),
+    AngleAxisf (-.5, Vector3f (1, 1, 0).normalized ()).toRotationMatrix ()
+  };
+
+  // A pose some other run of the same arm reached, so it is reachable.
+  cout << "Arm::solve to a pose, 16 joints (steps to within 1e-3)" << endl;
+  cout << "solver\tsteps\tposition\tangle" << endl;
+  Arm target = makeArm (16, IK_DLS);
+  for (int step = 0; step < 300; step++) target.stepTowards (goals[0]);
+  Vector3f goal = target.getJoints ().col (16);
+  Matrix3f orientation = target.tipRotation ();
+  for (int s = 0; s < 5; s++) {
+    Arm arm = makeArm (16, solvers[s]);
+    IKResult result = arm.solve (goal, orientation, 1e-3, 10000);
+    AngleAxisf left (orientation * arm.tipRotation ().transpose ());
+    cout << names[s] << "\t" << result.iterations << "\t"
+         << (goal - arm.getJoints ().col (16)).norm () << "\t"
+         << left.angle () << endl;
+  }
+  cout << endl;
+
+  for (int s = 0; s < 5; s++) {
+    cout << "Arm::stepTowards, position vs pose (" << names[s]
+         << ", ns/op)" << endl;
+    cout << "joints\tposition\tpose\tx position\tallocs/op" << endl;
+    for (int length = 4; length <= maxJoints; length *= 4) {
+      Arm position = makeArm (length, solvers[s]);
+      Arm pose = makeArm (length, solvers[s]);
+      int step = 0;
+      double positionNs = timeCalls ([&] () {
+        position.stepTowards (goals[(step++ / 16) % 2]);
+      }).ns;
+      step = 0;
+      Timing poseTime = timeCalls ([&] () {
+        int g = (step++ / 16) % 2;
+        pose.stepTowards (goals[g], turns[g]);
+      });
+      cout << length << "\t" << positionNs << "\t" << poseTime.ns << "\t"
+           << poseTime.ns / positionNs << "\t";
+      printAllocs (poseTime.allocs);
+      cout << endl;
+    }
+    cout << endl;
+  }
+}
+
+//****************************************************
+// CCD and FABRIK against the jacobian solvers
+//****************************************************
+
+// The largest difference between a link's length and its rest length.
+static float lengthDrift (const Arm& arm, const Arm& rest) {
+  float drift = 0;
+  for (int i = 0; i + 1 < arm.numJoints (); i++) {
+    float now = (arm.getJoints ().col (i + 1) - arm.getJoints ().col (i))
+      .norm ();
+    float then = (rest.getJoints ().col (i + 1) - rest.getJoints ().col (i))
+      .norm ();
+    drift = max (drift, abs (now - then));
+  }
+  return drift;
+}
+
+// CCD, FABRIK and LM steps are whole iterations, and the others' are
+// scaled by STEP_SIZE, so compare what it costs to reach a goal rather
+// than to take a step.
+static void benchSolve (int maxJoints) {
+  const char *names[] = {"svd", "dls", "ccd", "fabrik", "lm"};
+  IKSolver solvers[] = {IK_SVD, IK_DLS, IK_CCD, IK_FABRIK, IK_LM};
+  Vector3f goals[] = {Vector3f (1, 2, 1), Vector3f (-1, 1, 2),
+                      Vector3f (2, -1, .5), Vector3f (.5, .5, -2)};
+  cout << "Arm::solve to within 1e-3 (us and steps per goal)" << endl;
+  cout << "joints";
+  for (int s = 0; s < 5; s++) cout << "\t" << names[s] << "\tsteps";
+  cout << endl;
+  float drift = 0;
+  for (int length = 4; length <= maxJoints; length *= 4) {
+    cout << length;
+    for (int s = 0; s < 5; s++) {
+      Arm arm = makeArm (length, solvers[s]);
+      long solves = 0, steps = 0;
+      double ns = timeCalls ([&] () {
+        IKResult result = arm.solve (goals[solves++ % 4], 1e-3, 100000);
+        steps += result.iterations;
+      }).ns;
+      cout << "\t" << ns / 1000 << "\t" << (double) steps / solves;
+      if (solvers[s] == IK_FABRIK) {
+        drift = max (drift, lengthDrift (arm, makeArm (length, IK_SVD)));
+      }
+    }
+    cout << endl;
+  }
+  cout << "fabrik link lengths within " << drift << " of rest" << endl;
+  cout << endl;
+}
+
+//****************************************************
+// Nullspace objectives
+//****************************************************
+
+// log det (J J^T), which the manipulability objective raises.
+static float logManipulability (Arm& arm) {
+  MatrixXf jac = arm.jacobian ();
+  return log ((jac * jac.transpose ()).determinant ());
+}
+
+static void benchNullspace (int maxJoints) {
+  const char *names[] = {"none", "rest", "limits", "manipulability"};
+  Vector3f weights[] = {Vector3f (0, 0, 0), Vector3f (1, 0, 0),
+                        Vector3f (0, 1, 0), Vector3f (0, 0, 1)};
+  Vector3f goals[] = {Vector3f (1, 2, 1), Vector3f (-1, 1, 2)};
+
+  // The demo arm, with limits to keep clear of, held on each goal.
+  cout << "Arm::stepTowards (svd), 4 joints limited to +-1.5 rad, after"
+       << " 200 steps on each goal" << endl;
+  cout << "objective	tip error	rest angle	limit use	log det" << endl;
+  for (int o = 0; o < 4; o++) {
+    Arm arm;
+    JointLimits limits (Vector3f::Constant (-1.5), Vector3f::Constant (1.5));
+    arm.addJoint (1, 0, 0, limits);
+    arm.addJoint (2, 0, 0, limits);
+    arm.addJoint (2.5, 0, 0, limits);
+    arm.addJoint (4, 0, 0, limits);
+    arm.setNullspace (weights[o](0), weights[o](1), weights[o](2));
+    float error = 0, rest = 0, use = 0, manipulability = 0;
+    for (int g = 0; g < 2; g++) {
+      for (int step = 0; step < 200; step++) arm.stepTowards (goals[g]);
+      error = max (error, (goals[g] - arm.getJoints ().col (4)).norm ());
+      for (int i = 0; i < 4; i++) {
+        Vector3f angle = arm.jointRotation (i);
+        rest += angle.norm () / 8;
+        use = max (use, angle.cwiseAbs ().maxCoeff () / 1.5f);
+      }
+      manipulability += logManipulability (arm) / 2;
+    }
+    cout << names[o] << "	" << error << "	" << rest << "	" << use
+         << "	" << manipulability << endl;
+  }
+  cout << endl;
+
+  const char *solverNames[] = {"svd", "dls"};
+  IKSolver solvers[] = {IK_SVD, IK_DLS};
+  for (int s = 0; s < 2; s++) {
+    cout << "Arm::stepTowards, without and with all three objectives ("
+         << solverNames[s] << ", ns/op)" << endl;
+    cout << "joints	without	with	x without	allocs/op" << endl;
+    for (int length = 4; length <= maxJoints; length *= 4) {
+      Arm plain = makeArm (length, solvers[s]);
+      Arm nullspace = makeArm (length, solvers[s]);
+      nullspace.setNullspace (1, 1, 1);
+      int step = 0;
+      double plainNs = timeCalls ([&] () {
+        plain.stepTowards (goals[(step++ / 16) % 2]);
+      }).ns;
+      step = 0;
+      Timing nullspaceTime = timeCalls ([&] () {
+        nullspace.stepTowards (goals[(step++ / 16) % 2]);
+      });
+      cout << length << "	" << plainNs << "	" << nullspaceTime.ns << "	"
+           << nullspaceTime.ns / plainNs << "	";
+      printAllocs (nullspaceTime.allocs);
+      cout << endl;
+    }
+    cout << endl;
+  }
+}
+
+int main (int argc, char *argv[]) {
+  int maxJoints = 1024;
+  string section;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-m" && i + 1 < argc) {
+      maxJoints = atoi (argv[++i]);
+    } else if (arg == "-t" && i + 1 < argc) {
+      minTime = atof (argv[++i]);
+    } else if (arg[0] != '-' && section.empty ()) {
+      section = arg;
+    } else {
+      cerr << "Usage: " << argv[0] << " [-m maxJoints] [-t seconds]"
+           << " [primitives|arm|fk|fixed|precision|limits|hinges|skeleton"
+           << "|pose|solve|nullspace]" << endl;
+      return 1;
+    }
+  }
+
+  if (section.empty () || section == "primitives") benchPrimitives ();
+  if (section.empty () || section == "arm") benchArm (maxJoints);
+  if (section.empty () || section == "fk") benchForwardKinematics (maxJoints);
+  if (section.empty () || section == "fixed") benchFixed ();
+  if (section.empty () || section == "precision") benchPrecision (maxJoints);
+  if (section.empty () || section == "limits") benchLimits (maxJoints);
+  if (section.empty () || section == "hinges") benchHinges (maxJoints);
+  if (section.empty () || section == "skeleton") benchSkeleton (maxJoints);
+  if (section.empty () || section == "pose") benchPose (maxJoints);
+  if (section.empty () || section == "solve") benchSolve (maxJoints);
+  if (section.empty () || section == "nullspace") benchNullspace (maxJoints);
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "armbatch.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+using namespace Eigen;
+
+/*
+Throughput benchmark for ArmBatch. Builds a batch of arms with a spread
+of chain lengths, then times batched steps at 1, 2, 4, ... threads up to
+the OpenMP maximum and reports solves/sec for each.
+
+Usage: bench_batch [-a arms] [-j maxJoints] [-n ticks]
+*/
+
+static void usage (const char *name) {
+  cerr << "Usage: " << name << " [-a arms] [-j maxJoints] [-n ticks]" << endl;
+}
+
+// Builds the same batch every time, so runs can be compared.
+static ArmBatch makeBatch (int numArms, int maxJoints) {
+  ArmBatch batch;
+  srand (184);
+  for (int a = 0; a < numArms; a++) {
+    Arm arm;
+    int length = 4 + rand () % (maxJoints - 3);
+    for (int i = 1; i <= length; i++) {
+      arm.addJoint (4.f * i / length, 0, 0);
+    }
+    batch.add (arm);
+  }
+  return batch;
+}
+
+// Goal for arm a at tick t, the demo's figure eight with a phase offset.
+static Vector3f goal (int a, int t) {
+  float s = .01f * t + a;
+  return 2 * Vector3f (cos (s), sin (s) * cos (s), 0) + Vector3f (0, 1, 2);
+}
+
+int main (int argc, char *argv[]) {
+  int numArms = 4096;
+  int maxJoints = 64;
+  int ticks = 20;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-a" && i + 1 < argc) {
+      numArms = atoi (argv[++i]);
+    } else if (arg == "-j" && i + 1 < argc) {
+      maxJoints = atoi (argv[++i]);
+    } else if (arg == "-n" && i + 1 < argc) {
+      ticks = atoi (argv[++i]);
+    } else {
+      usage (argv[0]);
+      return 1;
+    }
+  }
+  if (numArms < 1 || maxJoints < 4 || ticks < 1) {
+    usage (argv[0]);
+    return 1;
+  }
+
+  // Precompute the goals so only stepping is timed.
+  vector<Matrix3Xf> goals (ticks, Matrix3Xf (3, numArms));
+  for (int t = 0; t < ticks; t++) {
+    for (int a = 0; a < numArms; a++) {
+      goals[t].col (a) = goal (a, t);
+    }
+  }
+
+#ifdef _OPENMP
+  int maxThreads = omp_get_max_threads ();
+#else
+  int maxThreads = 1;
+#endif
+
+  cout << numArms << " arms, 4-" << maxJoints << " joints, "
+       << ticks << " ticks" << endl;
+  cout << "threads\tsolves/sec\tspeedup\tmatches 1 thread" << endl;
+
+  Matrix3Xf reference;
+  double baseRate = 0;
+  for (int threads = 1; ; threads = min (2 * threads, maxThreads)) {
+    ArmBatch batch = makeBatch (numArms, maxJoints);
+    batch.setThreads (threads);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now ();
+    for (int t = 0; t < ticks; t++) {
+      batch.stepTowards (goals[t]);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now () - start;
+
+    // Collect the tips to check the result doesn't depend on threading.
+    Matrix3Xf tips (3, numArms);
+    for (int a = 0; a < numArms; a++) {
+      const Matrix3Xf& joints = batch.getArm (a).getJoints ();
+      tips.col (a) = joints.col (joints.cols () - 1);
+    }
+    if (threads == 1) reference = tips;
+
+    double rate = (double) numArms * ticks / elapsed.count ();
+    if (threads == 1) baseRate = rate;
+    cout << threads << "\t" << rate << "\t" << rate / baseRate << "\t"
+         << (tips == reference ? "yes" : "no") << endl;
+
+    if (threads == maxThreads) break;
+  }
+  return 0;
+}
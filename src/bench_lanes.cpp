@@ -0,0 +1,97 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "armlanes.h"
+
+using namespace std;
+using namespace Eigen;
+
+/*
+Benchmark and correctness check for ArmLanes. Steps the same set of
+same-length arms both as separate Arms (damped least squares) and with
+the lanes kernel, then reports solves/sec for each and the largest
+difference between their joint positions.
+
+Usage: bench_lanes [-a arms] [-j joints] [-n ticks]
+*/
+
+static void usage (const char *name) {
+  cerr << "Usage: " << name << " [-a arms] [-j joints] [-n ticks]" << endl;
+}
+
+// Goal for arm a at tick t, the demo's figure eight with a phase offset.
+static Vector3f goal (int a, int t) {
+  float s = .01f * t + a;
+  return 2 * Vector3f (cos (s), sin (s) * cos (s), 0) + Vector3f (0, 1, 2);
+}
+
+int main (int argc, char *argv[]) {
+  int numArms = 4096;
+  int length = 8;
+  int ticks = 100;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-a" && i + 1 < argc) {
+      numArms = atoi (argv[++i]);
+    } else if (arg == "-j" && i + 1 < argc) {
+      length = atoi (argv[++i]);
+    } else if (arg == "-n" && i + 1 < argc) {
+      ticks = atoi (argv[++i]);
+    } else {
+      usage (argv[0]);
+      return 1;
+    }
+  }
+  if (numArms < 1 || length < 1 || ticks < 1) {
+    usage (argv[0]);
+    return 1;
+  }
+
+  Arm arm;
+  arm.setSolver (IK_DLS);
+  for (int i = 1; i <= length; i++) {
+    arm.addJoint (4.f * i / length, 0, 0);
+  }
+  vector<Arm> arms (numArms, arm);
+  ArmLanes lanes (numArms, arm);
+
+  // Precompute the goals so only stepping is timed.
+  vector<Matrix3Xf> goals (ticks, Matrix3Xf (3, numArms));
+  for (int t = 0; t < ticks; t++) {
+    for (int a = 0; a < numArms; a++) {
+      goals[t].col (a) = goal (a, t);
+    }
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now ();
+  for (int t = 0; t < ticks; t++) {
+    for (int a = 0; a < numArms; a++) {
+      arms[a].stepTowards (goals[t].col (a));
+    }
+  }
+  chrono::duration<double> armTime = chrono::steady_clock::now () - start;
+
+  start = chrono::steady_clock::now ();
+  for (int t = 0; t < ticks; t++) {
+    lanes.stepTowards (goals[t]);
+  }
+  chrono::duration<double> laneTime = chrono::steady_clock::now () - start;
+
+  float maxDiff = 0;
+  for (int a = 0; a < numArms; a++) {
+    Matrix3Xf diff = lanes.getJoints (a) - arms[a].getJoints ();
+    maxDiff = max (maxDiff, diff.cwiseAbs ().maxCoeff ());
+  }
+
+  double solves = (double) numArms * ticks;
+  cout << numArms << " arms, " << length + 1 << " joints, "
+       << ticks << " ticks, " << LANE_WIDTH << " lanes" << endl;
+  cout << "Arm:      " << solves / armTime.count () << " solves/sec" << endl;
+  cout << "ArmLanes: " << solves / laneTime.count () << " solves/sec ("
+       << armTime.count () / laneTime.count () << "x)" << endl;
+  cout << "Max joint difference: " << maxDiff << endl;
+  return maxDiff < 1e-3 ? 0 : 1;
+}
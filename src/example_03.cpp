@@ -38,6 +38,7 @@ GLfloat rotation[3] = {0.0f, 0.0f, 0.0f};
 bool wireframe_mode = false;
 bool flat_shading = false;
 bool auto_strech = false;
+bool show_stats = false;
 int Width_global = 400;
 int Height_global = 400;
 int Z_buffer_bit_depth = 128;
@@ -53,6 +54,19 @@ Vector3f figure_eight (float t) {
 
 inline float sqr(float x) { return x*x; }
 
+//****************************************************
+// Print the solver's per-stage timings for the last frame
+//****************************************************
+void print_stats (int frame)
+{
+    const ArmStats& stats = arm.getStats ();
+    cerr << "frame " << frame << ": " << stats.steps << " steps, "
+         << "jacobian " << stats.jacobian * 1e6 << " us, "
+         << "solve " << stats.solve * 1e6 << " us, "
+         << "rotate " << stats.rotate * 1e6 << " us" << endl;
+    arm.resetStats ();
+}
+
 //****************************************************
 // Simple init function
 //****************************************************
@@ -135,6 +149,16 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
             zoom *= .8f;
           }
           break; 
+        case GLFW_KEY_T:
+          if (action == GLFW_PRESS) {
+#ifdef ARM_STATS
+            show_stats = !show_stats;
+            arm.resetStats ();
+#else
+            cerr << "Rebuild with -DARM_STATS=ON for solver timings" << endl;
+#endif
+          }
+          break;
         case GLFW_KEY_F:
           if (action && mods == GLFW_MOD_SHIFT) auto_strech = !auto_strech; break;
         default: break;
@@ -161,7 +185,7 @@ void display( GLFWwindow* window )
   
   // Render joint spheres
   int numJoints = arm.numJoints ();
-  Matrix<float, 3, Dynamic> joints = arm.getJoints ();
+  const Matrix3Xf& joints = arm.getJoints ();
   glColor3f(1,1,0);
   GLUquadric *quad = gluNewQuadric ();
   for (int i = 0; i < numJoints; i++) {
@@ -232,6 +256,9 @@ int main(int argc, char *argv[]) {
   arm.addJoint (2, 0, 0);
   arm.addJoint (2.5, 0, 0);
   arm.addJoint (4, 0, 0);
+  // The figure eight moves at most ~.03 per frame, so the solver can
+  // keep its factorization for a few frames at a time.
+  arm.setCoherence (.05, 4);
 
   //This initializes glfw
   initializeRendering();
@@ -270,11 +297,14 @@ int main(int argc, char *argv[]) {
   glfwSetWindowSizeCallback(window, size_callback);
   glfwSetKeyCallback(window, key_callback);
 
+  int frame = 0;
   while ( !glfwWindowShouldClose( window ) ) // infinite loop to draw object again and again
   {   // because once object is draw then window is terminated
       arm.stepTowards (figure_eight (t));
+      if (show_stats) print_stats (frame);
       display( window );
       t += 0.01;
+      frame++;
       
       if (auto_strech){
           glfwSetWindowSize(window, mode->width, mode->height);
@@ -0,0 +1,332 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include "arm.h"
+
+using namespace std;
+using namespace Eigen;
+
+/*
+Headless driver for Arm::stepTowards. Reads an arm and a stream of goals,
+then runs the solver back to back with no rendering in the loop.
+
+Input is one command per line; '#' starts a comment.
+  root x y z     Reset the arm to a bare root at (x, y, z).
+  joint x y z [lx ly lz ux uy uz]
+                 Append a joint (see Arm::addJoint), optionally limited to
+                 rotations between (lx, ly, lz) and (ux, uy, uz) radians
+                 (see JointLimits).
+  hinge x y z ax ay az [lower upper]
+                 Append a joint turning only about the axis (ax, ay, az)
+                 (see JointAxes), optionally between lower and upper.
+  universal x y z ax ay az bx by bz
+                 Append a joint turning about two axes.
+  goal x y z     Queue a goal. A bare "x y z" line is shorthand for this.
+  pose x y z rx ry rz
+                 Queue a pose goal: the tip at (x, y, z), with the last
+                 link turned from its rest pose by the rotation vector
+                 (rx, ry, rz) (see Arm::tipRotation).
+If no joints are given, the four-joint arm from the demo is used.
+
+Usage: iksolve [-n steps] [-e tol] [-b usec] [-s solver] [-l lambda]
+               [-c delta] [-r steps] [-w weight] [-u r,l,m] [-q] [file]
+  -n steps       Solver steps per goal (default 1, like one demo frame).
+  -e tol         Stop early once the tip is within tol of the goal, making
+                 -n an upper bound (see Arm::solve).
+  -b usec        Per-goal time budget in microseconds, for use with -e.
+  -s solver      svd (default), dls, sdls, transpose, cg, ccd, fabrik
+                 or lm.
+  -l lambda      Damping for the dls solver, and where lm starts.
+  -c delta       Reuse the solver's factorization while the goal stays
+                 within delta of the one it was made for.
+  -r steps       With -c, refactor at least every steps steps (default 4).
+  -w weight      Weight of a pose goal's rotation error, in units of
+                 distance per radian (default 1; see PoseWeights).
+  -u r,l,m       Spend the nullspace on the rest pose, joint limits and
+                 manipulability, with these weights (see
+                 Arm::setNullspace).
+  -q             Don't print the tip position reached for each goal.
+  file           Read from file instead of stdin.
+*/
+
+static void usage (const char *name) {
+  cerr << "Usage: " << name << " [-n steps] [-e tol] [-b usec]"
+       << " [-s solver] [-l lambda] [-c delta] [-r steps] [-w weight]"
+       << " [-u r,l,m] [-q] [file]"
+       << endl;
+}
+
+// A joint line: the point it places, and its axes and limits.
+struct JointLine {
+  Vector3f point;
+  JointAxes axes;
+  JointLimits limits;
+};
+
+// A goal line: where the tip should go, and for a pose goal how it
+// should be turned.
+struct GoalLine {
+  Vector3f point;
+  bool pose;
+  Matrix3f orientation;
+};
+
+// Reads n floats into v. Returns false if any is missing.
+static bool readFloats (istream& in, float *v, int n) {
+  for (int i = 0; i < n; i++) {
+    if (!(in >> v[i])) return false;
+  }
+  return true;
+}
+
+//****************************************************
+// Parse the input stream. Returns false on a bad line.
+//****************************************************
+static bool parse (istream& in, Vector3f& root, vector<JointLine>& joints,
+                   vector<GoalLine>& goals) {
+  string line;
+  int lineno = 0;
+  while (getline (in, line)) {
+    lineno++;
+    // Strip comments.
+    size_t hash = line.find ('#');
+    if (hash != string::npos) line.erase (hash);
+
+    istringstream ss (line);
+    string cmd;
+    if (!(ss >> cmd)) continue;
+
+    // A bare coordinate triple is a goal.
+    float x, y, z;
+    if (cmd == "root" || cmd == "joint" || cmd == "hinge"
+        || cmd == "universal" || cmd == "goal" || cmd == "pose") {
+      ss >> x >> y >> z;
+    } else {
+      ss.clear ();
+      ss.str (line);
+      cmd = "goal";
+      ss >> x >> y >> z;
+    }
+    if (!ss) {
+      cerr << "line " << lineno << ": expected three coordinates" << endl;
+      return false;
+    }
+
+    JointLine joint;
+    joint.point = Vector3f (x, y, z);
+    float v[6];
+    if (cmd == "root") {
+      root = Vector3f (x, y, z);
+      joints.clear ();
+    } else if (cmd == "joint") {
+      // Limits are optional, but all six or none.
+      if (ss >> v[0]) {
+        if (!readFloats (ss, v + 1, 5)) {
+          cerr << "line " << lineno << ": expected six limits" << endl;
+          return false;
+        }
+        joint.limits = JointLimits (Vector3f (v[0], v[1], v[2]),
+                                    Vector3f (v[3], v[4], v[5]));
+      }
+      joints.push_back (joint);
+    } else if (cmd == "hinge") {
+      if (!readFloats (ss, v, 3)) {
+        cerr << "line " << lineno << ": expected an axis" << endl;
+        return false;
+      }
+      joint.axes = JointAxes (Vector3f (v[0], v[1], v[2]));
+      if (ss >> v[3]) {
+        if (!(ss >> v[4])) {
+          cerr << "line " << lineno << ": expected two limits" << endl;
+          return false;
+        }
+        joint.limits.lower(0) = v[3];
+        joint.limits.upper(0) = v[4];
+      }
+      joints.push_back (joint);
+    } else if (cmd == "universal") {
+      if (!readFloats (ss, v, 6)) {
+        cerr << "line " << lineno << ": expected two axes" << endl;
+        return false;
+      }
+      joint.axes = JointAxes (Vector3f (v[0], v[1], v[2]),
+                              Vector3f (v[3], v[4], v[5]));
+      joints.push_back (joint);
+    } else {
+      GoalLine goal;
+      goal.point = Vector3f (x, y, z);
+      goal.pose = cmd == "pose";
+      goal.orientation.setIdentity ();
+      if (goal.pose) {
+        if (!readFloats (ss, v, 3)) {
+          cerr << "line " << lineno << ": expected a rotation" << endl;
+          return false;
+        }
+        Vector3f r (v[0], v[1], v[2]);
+        if (r.norm () > 0) {
+          goal.orientation = AngleAxisf (r.norm (), r.normalized ())
+            .toRotationMatrix ();
+        }
+      }
+      goals.push_back (goal);
+    }
+  }
+  return true;
+}
+
+int main (int argc, char *argv[]) {
+  int steps = 1;
+  float tolerance = -1;
+  double budget = 0;
+  IKSolver solver = IK_SVD;
+  float lambda = -1;
+  float coherence = 0;
+  int reuseSteps = 4;
+  float weight = 1;
+  float nullspace[3] = {0, 0, 0};
+  bool quiet = false;
+  const char *path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-n" && i + 1 < argc) {
+      steps = atoi (argv[++i]);
+    } else if (arg == "-e" && i + 1 < argc) {
+      tolerance = atof (argv[++i]);
+    } else if (arg == "-b" && i + 1 < argc) {
+      budget = atof (argv[++i]) * 1e-6;
+    } else if (arg == "-s" && i + 1 < argc) {
+      string name = argv[++i];
+      if (name == "svd") solver = IK_SVD;
+      else if (name == "dls") solver = IK_DLS;
+      else if (name == "sdls") solver = IK_SDLS;
+      else if (name == "transpose") solver = IK_TRANSPOSE;
+      else if (name == "cg") solver = IK_CG;
+      else if (name == "ccd") solver = IK_CCD;
+      else if (name == "fabrik") solver = IK_FABRIK;
+      else if (name == "lm") solver = IK_LM;
+      else {
+        usage (argv[0]);
+        return 1;
+      }
+    } else if (arg == "-l" && i + 1 < argc) {
+      lambda = atof (argv[++i]);
+    } else if (arg == "-c" && i + 1 < argc) {
+      coherence = atof (argv[++i]);
+    } else if (arg == "-r" && i + 1 < argc) {
+      reuseSteps = atoi (argv[++i]);
+    } else if (arg == "-w" && i + 1 < argc) {
+      weight = atof (argv[++i]);
+    } else if (arg == "-u" && i + 1 < argc) {
+      if (sscanf (argv[++i], "%f,%f,%f", &nullspace[0], &nullspace[1],
+                  &nullspace[2]) < 1) {
+        usage (argv[0]);
+        return 1;
+      }
+    } else if (arg == "-q") {
+      quiet = true;
+    } else if (arg[0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      usage (argv[0]);
+      return 1;
+    }
+  }
+  if (steps < 1) {
+    usage (argv[0]);
+    return 1;
+  }
+
+  Vector3f root (0, 0, 0);
+  vector<JointLine> joints;
+  vector<GoalLine> goals;
+  bool ok;
+  if (path) {
+    ifstream file (path);
+    if (!file) {
+      cerr << "Cannot open " << path << endl;
+      return 1;
+    }
+    ok = parse (file, root, joints, goals);
+  } else {
+    ok = parse (cin, root, joints, goals);
+  }
+  if (!ok) return 1;
+
+  // Build the arm, falling back on the demo arm.
+  Arm arm (root(0), root(1), root(2));
+  arm.setSolver (solver);
+  if (lambda >= 0) arm.setDamping (lambda);
+  if (coherence > 0) arm.setCoherence (coherence, reuseSteps);
+  arm.setNullspace (nullspace[0], nullspace[1], nullspace[2]);
+  if (joints.empty ()) {
+    arm.addJoint (1, 0, 0);
+    arm.addJoint (2, 0, 0);
+    arm.addJoint (2.5, 0, 0);
+    arm.addJoint (4, 0, 0);
+  }
+  for (size_t j = 0; j < joints.size (); j++) {
+    const JointLine& joint = joints[j];
+    arm.addJoint (joint.point(0), joint.point(1), joint.point(2),
+                  joint.axes, joint.limits);
+  }
+
+  // Run the solver. Tips are buffered so output stays out of the timing.
+  PoseWeights weights;
+  weights << 1, 1, 1, weight, weight, weight;
+  Matrix3Xf tips (3, goals.size ());
+  double total = 0;
+  int converged = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now ();
+  for (size_t g = 0; g < goals.size (); g++) {
+    const GoalLine& goal = goals[g];
+    if (tolerance >= 0) {
+      IKResult result = goal.pose ?
+        arm.solve (goal.point, goal.orientation, tolerance, steps, budget,
+                   weights) :
+        arm.solve (goal.point, tolerance, steps, budget);
+      total += result.iterations;
+      if (result.status == IK_CONVERGED) converged++;
+    } else {
+      for (int s = 0; s < steps; s++) {
+        if (goal.pose) {
+          arm.stepTowards (goal.point, goal.orientation, weights);
+        } else {
+          arm.stepTowards (goal.point);
+        }
+      }
+      total += steps;
+    }
+    tips.col (g) = arm.getJoints ().col (arm.numJoints () - 1);
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now () - start;
+
+  if (!quiet) {
+    for (size_t g = 0; g < goals.size (); g++) {
+      cout << tips (0, g) << " " << tips (1, g) << " " << tips (2, g) << "\n";
+    }
+  }
+
+  cerr << arm.numJoints () << " joints, " << goals.size () << " goals, "
+       << total << " steps in " << elapsed.count () << " s";
+  if (elapsed.count () > 0) {
+    cerr << " (" << total / elapsed.count () << " steps/sec)";
+  }
+  cerr << endl;
+#ifdef ARM_STATS
+  const ArmStats& stats = arm.getStats ();
+  cerr << "jacobian " << stats.jacobian << " s, solve " << stats.solve
+       << " s, rotate " << stats.rotate << " s, " << stats.reuses
+       << " reused factorizations" << endl;
+#endif
+  if (tolerance >= 0) {
+    cerr << converged << " of " << goals.size () << " goals within "
+         << tolerance << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,224 @@
+#include "jacobian.h"
+#include "kinematics.h"
+#include "normaloperator.h"
+#include <cmath>
+
+// Conjugate gradient limits. J^T J has rank 3, so the damped system has
+// at most four distinct eigenvalues and CG converges in four iterations
+// in exact arithmetic; the rest is slack for float rounding.
+#define CG_MAX_ITERATIONS 8
+#define CG_TOLERANCE 1e-4
+
+using namespace Eigen;
+using namespace std;
+
+template <typename Scalar>
+int ArmJacobian<Scalar>::rows (void) const {
+  return 3;
+};
+
+template <typename Scalar>
+int ArmJacobian<Scalar>::cols (void) const {
+  if (this->columns.cols ()) return this->columns.cols ();
+  return 3 * (this->joints.cols () - 1);
+};
+
+// J v, one cross product per joint.
+template <typename Scalar>
+typename ArmJacobian<Scalar>::Vector3
+ArmJacobian<Scalar>::operator* (const Ref<const VectorX>& v) const {
+  if (this->columns.cols ()) return this->columns * v;
+  int length = this->joints.cols () - 1;
+  Vector3 tip = this->joints.col (length);
+  Vector3 sum = Vector3::Zero ();
+  for (int i = 0; i < length; i++) {
+    Vector3 diff = this->joints.col (i) - tip;
+    sum += diff.cross (v.template segment<3>(3*i));
+  }
+  return sum;
+};
+
+// out = J^T u. crossmat (d)^T u = -(d x u) = u x d.
+template <typename Scalar>
+void ArmJacobian<Scalar>::transposeTimes (const Vector3& u,
+                                          Ref<VectorX> out) const {
+  if (this->columns.cols ()) {
+    out.noalias () = this->columns.transpose () * u;
+    return;
+  }
+  int length = this->joints.cols () - 1;
+  Vector3 tip = this->joints.col (length);
+  for (int i = 0; i < length; i++) {
+    Vector3 diff = this->joints.col (i) - tip;
+    out.template segment<3>(3*i) = u.cross (diff);
+  }
+};
+
+// out += J^T u.
+template <typename Scalar>
+void ArmJacobian<Scalar>::addTransposeTimes (const Vector3& u,
+                                             Ref<VectorX> out) const {
+  if (this->columns.cols ()) {
+    out.noalias () += this->columns.transpose () * u;
+    return;
+  }
+  int length = this->joints.cols () - 1;
+  Vector3 tip = this->joints.col (length);
+  for (int i = 0; i < length; i++) {
+    Vector3 diff = this->joints.col (i) - tip;
+    out.template segment<3>(3*i) += u.cross (diff);
+  }
+};
+
+// J J^T, accumulated straight from the joint positions.
+template <typename Scalar>
+typename ArmJacobian<Scalar>::Matrix3 ArmJacobian<Scalar>::gram (void)
+  const {
+  Matrix3 sum = Matrix3::Zero ();
+  if (this->columns.cols ()) {
+    // Column by column: as a product of 3 x n matrices, Eigen takes the
+    // general blocked path, which is many times slower at this shape.
+    for (int j = 0; j < this->columns.cols (); j++) {
+      sum.noalias () += this->columns.col (j) * this->columns.col (j)
+        .transpose ();
+    }
+    return sum;
+  }
+  int length = this->joints.cols () - 1;
+  Vector3 tip = this->joints.col (length);
+  for (int i = 0; i < length; i++) {
+    Vector3 diff = this->joints.col (i) - tip;
+    sum.diagonal ().array () += diff.squaredNorm ();
+    sum.noalias () -= diff * diff.transpose ();
+  }
+  return sum;
+};
+
+// Norm of column j. Column k of crossmat (d) is e_k x d, with squared
+// norm |d|^2 - d_k^2.
+template <typename Scalar>
+Scalar ArmJacobian<Scalar>::colNorm (int j) const {
+  if (this->columns.cols ()) return this->columns.col (j).norm ();
+  Vector3 tip = this->joints.col (this->joints.cols () - 1);
+  Vector3 diff = this->joints.col (j / 3) - tip;
+  Scalar d = diff(j % 3);
+  return sqrt (max (diff.squaredNorm () - d * d, Scalar (0)));
+};
+
+// joint i - tip, the vector block i crosses with.
+template <typename Scalar>
+typename ArmJacobian<Scalar>::Vector3 ArmJacobian<Scalar>::lever (int i)
+  const {
+  return this->joints.col (i) - this->joints.col (this->joints.cols () - 1);
+};
+
+// Writes J into dense, which must be 3 x cols ().
+template <typename Scalar>
+void ArmJacobian<Scalar>::evalTo (Ref<Matrix3X> dense) const {
+  if (this->columns.cols ()) {
+    dense = this->columns;
+    return;
+  }
+  int length = this->joints.cols () - 1;
+  Vector3 tip = this->joints.col (length);
+  for (int i = 0; i < length; i++) {
+    dense.template block<3,3>(0,3*i) = crossmat (this->joints.col (i) - tip);
+  }
+};
+
+// Writes J^T into dense, which must be cols () x 3. crossmat (d)^T is
+// crossmat (-d).
+template <typename Scalar>
+void ArmJacobian<Scalar>::evalTransposeTo (Ref<MatrixX3> dense) const {
+  if (this->columns.cols ()) {
+    dense = this->columns.transpose ();
+    return;
+  }
+  int length = this->joints.cols () - 1;
+  Vector3 tip = this->joints.col (length);
+  for (int i = 0; i < length; i++) {
+    dense.template block<3,3>(3*i,0) = crossmat (tip - this->joints.col (i));
+  }
+};
+
+// [J; A] v, the tip's move and turn. A ball joint turns the tip by its
+// own 3-vector, so A v is their sum.
+template <typename Scalar>
+typename ArmJacobian<Scalar>::Vector6
+ArmJacobian<Scalar>::poseTimes (const Ref<const VectorX>& v) const {
+  Vector6 out;
+  out.template head<3>() = *this * v;
+  if (this->axes.cols ()) {
+    out.template tail<3>() = this->axes * v;
+  } else {
+    out.template tail<3>() =
+      Map<const Matrix3X> (v.data (), 3, v.size () / 3).rowwise ().sum ();
+  }
+  return out;
+};
+
+// out = [J; A]^T u.
+template <typename Scalar>
+void ArmJacobian<Scalar>::poseTransposeTimes (const Vector6& u,
+                                              Ref<VectorX> out) const {
+  transposeTimes (u.template head<3>(), out);
+  if (this->axes.cols ()) {
+    out.noalias () += this->axes.transpose () * u.template tail<3>();
+  } else {
+    Map<Matrix3X> (out.data (), 3, out.size () / 3).colwise () +=
+      u.template tail<3>();
+  }
+};
+
+// [J; A] [J; A]^T. For ball joints the corner is the sum of
+// crossmat (d_i), which is crossmat of the summed d_i.
+template <typename Scalar>
+typename ArmJacobian<Scalar>::Matrix6 ArmJacobian<Scalar>::poseGram (void)
+  const {
+  Matrix6 sum;
+  sum.template topLeftCorner<3,3>() = gram ();
+  Matrix3 cross = Matrix3::Zero (), turn = Matrix3::Zero ();
+  if (this->axes.cols ()) {
+    for (int j = 0; j < this->axes.cols (); j++) {
+      cross.noalias () += this->columns.col (j)
+        * this->axes.col (j).transpose ();
+      turn.noalias () += this->axes.col (j) * this->axes.col (j).transpose ();
+    }
+  } else {
+    int length = this->joints.cols () - 1;
+    Vector3 levers = this->joints.leftCols (length).rowwise ().sum ()
+      - length * this->joints.col (length);
+    cross = crossmat (levers);
+    turn.diagonal ().setConstant (length);
+  }
+  sum.template topRightCorner<3,3>() = cross;
+  sum.template bottomLeftCorner<3,3>() = cross.transpose ();
+  sum.template bottomRightCorner<3,3>() = turn;
+  return sum;
+};
+
+// Conjugate gradients only need products with J and J^T, so nothing
+// 3N x 3N (or 3 x 3N) is formed. Unlike the other solvers, Eigen's CG
+// allocates a few 3N vectors per call.
+template <typename Scalar>
+void solveNormalCG (const ArmJacobian<Scalar>& jac, Scalar lambda,
+                    const Matrix<Scalar, 3, 1>& err,
+                    Ref<Matrix<Scalar, Dynamic, 1> > rhs,
+                    Ref<Matrix<Scalar, Dynamic, 1> > x) {
+  typedef NormalOperator<Scalar> Operator;
+  Operator normal (jac, lambda);
+  ConjugateGradient<Operator, Lower|Upper, IdentityPreconditioner> cg;
+  cg.setMaxIterations (CG_MAX_ITERATIONS);
+  cg.setTolerance (CG_TOLERANCE);
+  cg.compute (normal);
+  jac.transposeTimes (err, rhs);
+  x = cg.solveWithGuess (rhs, x);
+};
+
+template class ArmJacobian<float>;
+template class ArmJacobian<double>;
+
+template void solveNormalCG<float> (const ArmJacobian<float>&, float,
+  const Vector3f&, Ref<VectorXf>, Ref<VectorXf>);
+template void solveNormalCG<double> (const ArmJacobian<double>&, double,
+  const Vector3d&, Ref<VectorXd>, Ref<VectorXd>);
@@ -0,0 +1,83 @@
+#ifndef JACOBIAN_H
+#define JACOBIAN_H
+
+#include "Eigen/Dense"
+
+// The jacobian of an arm's tip position with respect to its joint
+// expmaps, as a lazily evaluated 3 x 3N operator over the joint
+// positions (tip last). Block i is crossmat (joint i - tip), so
+//
+//   J v    = sum over joints of (joint i - tip) x v_i,
+//   J^T u  = u x (joint i - tip) in block i,
+//   J J^T  = sum over joints of |d_i|^2 I - d_i d_i^T,
+//
+// and none of them need J itself.
+//
+// Joints that rotate about fewer than three axes (see JointAxes) have one
+// column per axis a, d_i x a, instead of a crossmat block. Those columns
+// have no structure to exploit, so such an arm writes them out, packed,
+// and passes them in; J is then 3 x (total dofs), narrower than 3 x 3N,
+// and the products are plain dense ones. Without them, every joint is a
+// ball joint on the world axes.
+//
+// For a pose goal, three more rows give the tip's rotation. Turning a
+// joint turns the tip by the same rotation, so below block i is the
+// identity for a ball joint, and a column a for each axis otherwise (the
+// axes are then passed in as well). The 6x6 gram of the stacked rows has
+// J J^T above, the sum of crossmat (d_i) (or of c a^T over the columns
+// c) beside it and N I (or the sum of a a^T) below, so it is O(N) too.
+//
+// The operator only refers to the
+// positions applyRotations writes, so it is current after every step
+// without being rebuilt. It must not outlive the joints it was made from,
+// which may be any 3 x n column-major matrix (a fixed-size arm's too).
+// Both are defined for float and double, in jacobian.cpp.
+
+template <typename Scalar>
+class ArmJacobian {
+  public:
+    typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+    typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
+    typedef Eigen::Matrix<Scalar, 3, Eigen::Dynamic> Matrix3X;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 3> MatrixX3;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorX;
+    typedef Eigen::Matrix<Scalar, 6, 1> Vector6;
+    typedef Eigen::Matrix<Scalar, 6, 6> Matrix6;
+  private:
+    Eigen::Ref<const Matrix3X> joints;
+    Eigen::Map<const Matrix3X> columns;
+    Eigen::Map<const Matrix3X> axes;
+  public:
+    ArmJacobian (const Eigen::Ref<const Matrix3X>& joints)
+      : joints (joints), columns (NULL, 3, 0), axes (NULL, 3, 0) {};
+    ArmJacobian (const Eigen::Ref<const Matrix3X>& joints,
+                 const Eigen::Ref<const Matrix3X>& columns,
+                 const Eigen::Ref<const Matrix3X>& axes)
+      : joints (joints), columns (columns.data (), 3, columns.cols ()),
+        axes (axes.data (), 3, axes.cols ()) {};
+    int rows (void) const;
+    int cols (void) const;
+    Vector3 operator* (const Eigen::Ref<const VectorX>& v) const;
+    void transposeTimes (const Vector3& u, Eigen::Ref<VectorX> out) const;
+    void addTransposeTimes (const Vector3& u, Eigen::Ref<VectorX> out) const;
+    Matrix3 gram (void) const;
+    Scalar colNorm (int j) const;
+    Vector3 lever (int i) const;
+    void evalTo (Eigen::Ref<Matrix3X> dense) const;
+    void evalTransposeTo (Eigen::Ref<MatrixX3> dense) const;
+    Vector6 poseTimes (const Eigen::Ref<const VectorX>& v) const;
+    void poseTransposeTimes (const Vector6& u, Eigen::Ref<VectorX> out)
+      const;
+    Matrix6 poseGram (void) const;
+};
+
+// Solves the damped normal equations (J^T J + lambda^2 I) x = J^T err by
+// matrix-free conjugate gradients, starting from the guess in x. rhs is
+// scratch space the size of x.
+template <typename Scalar>
+void solveNormalCG (const ArmJacobian<Scalar>& jac, Scalar lambda,
+                    const Eigen::Matrix<Scalar, 3, 1>& err,
+                    Eigen::Ref<Eigen::Matrix<Scalar, Eigen::Dynamic, 1> > rhs,
+                    Eigen::Ref<Eigen::Matrix<Scalar, Eigen::Dynamic, 1> > x);
+
+#endif
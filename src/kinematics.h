@@ -0,0 +1,120 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include "Eigen/Dense"
+#include <algorithm>
+#include <cmath>
+
+// Fraction of the solved rotation applied per step.
+#define STEP_SIZE .05
+
+// crossmat and rodriguez take any 3-vector expression and work in its
+// scalar type, so float and double arms share them.
+
+// Skew-symmetric matrix such that crossmat (v) * u = v x u.
+template <typename Derived>
+Eigen::Matrix<typename Derived::Scalar, 3, 3>
+crossmat (const Eigen::MatrixBase<Derived>& v) {
+  Eigen::Matrix<typename Derived::Scalar, 3, 3> m;
+  m << 0, -v(2), v(1),
+       v(2), 0, -v(0),
+       -v(1), v(0), 0;
+  return m;
+};
+
+// Coefficients of the rotation by an angle whose square is t2, as
+// cos I + a K + b v v^T for K = crossmat (v) and |v| the angle: a is
+// sin / angle and b is (1 - cos) / angle^2. While angle^6 is under 5040
+// epsilon, the Taylor series to the angle^4 terms is exact to rounding
+// and takes no trig; above that, the half-angle forms avoid the
+// cancellation in 1 - cos. Either way nothing divides by zero.
+template <typename Scalar>
+void rodriguezCoefficients (Scalar t2, Scalar& a, Scalar& b, Scalar& c) {
+  if (t2 * t2 * t2 < 5040 * Eigen::NumTraits<Scalar>::epsilon ()) {
+    a = 1 - t2 / 6 * (1 - t2 / 20);
+    b = (Scalar) .5 - t2 / 24 * (1 - t2 / 30);
+  } else {
+    Scalar t = std::sqrt (t2);
+    Scalar s = std::sin (t / 2), h = std::cos (t / 2);
+    a = 2 * s * h / t;
+    b = 2 * s * s / t2;
+  }
+  c = 1 - t2 * b;
+};
+
+// Rotation by the exponential map r, scaled by STEP_SIZE. A zero r is
+// the identity.
+template <typename Derived>
+Eigen::Matrix<typename Derived::Scalar, 3, 3>
+rodriguez (const Eigen::MatrixBase<Derived>& r) {
+  typedef typename Derived::Scalar Scalar;
+  Eigen::Matrix<Scalar, 3, 1> v = r * (Scalar) STEP_SIZE;
+  Scalar a, b, c;
+  rodriguezCoefficients (v.dot (v), a, b, c);
+  Eigen::Matrix<Scalar, 3, 3> m = b * v * v.transpose ();
+  m.diagonal ().array () += c;
+  m(0,1) -= a * v(2); m(1,0) += a * v(2);
+  m(0,2) += a * v(1); m(2,0) -= a * v(1);
+  m(1,2) -= a * v(0); m(2,1) += a * v(0);
+  return m;
+};
+
+// rodriguez for every column of r at once, into out's 3x3 blocks in
+// order (out must have 3 r.cols () columns). Columns go in batches of
+// RODRIGUEZ_BATCH so the trig and the coefficients run as packets; the
+// Taylor branch is picked per column by select.
+#define RODRIGUEZ_BATCH 8
+
+template <typename Derived, typename Out>
+void rodriguezBatch (const Eigen::MatrixBase<Derived>& r,
+                     Eigen::MatrixBase<Out>& out) {
+  typedef typename Derived::Scalar Scalar;
+  typedef Eigen::Array<Scalar, 1, RODRIGUEZ_BATCH> Batch;
+  const Scalar small =
+    std::cbrt (5040 * Eigen::NumTraits<Scalar>::epsilon ());
+  Eigen::Array<Scalar, 3, RODRIGUEZ_BATCH> v;
+  for (int first = 0; first < r.cols (); first += RODRIGUEZ_BATCH) {
+    int count = std::min (int (RODRIGUEZ_BATCH), int (r.cols ()) - first);
+    // A short last batch is padded with zero rotations.
+    v.setZero ();
+    v.leftCols (count) =
+      r.middleCols (first, count).array () * (Scalar) STEP_SIZE;
+    Batch t2 = v.square ().colwise ().sum ();
+    Batch t = t2.sqrt ();
+    Batch s = (t / 2).sin (), h = (t / 2).cos ();
+    Batch safe = (t2 > 0).select (t2, Batch::Ones ());
+    Batch a = (t2 < small).select (1 - t2 / 6 * (1 - t2 / 20),
+                                   2 * s * h / safe.sqrt ());
+    Batch b = (t2 < small).select ((Scalar) .5 - t2 / 24 * (1 - t2 / 30),
+                                   2 * s * s / safe);
+    Batch c = 1 - t2 * b;
+    Batch x = v.row (0), y = v.row (1), z = v.row (2);
+    Batch bxy = b * x * y, bxz = b * x * z, byz = b * y * z;
+    Batch m[9] = {c + b * x * x, bxy - a * z, bxz + a * y,
+                  bxy + a * z, c + b * y * y, byz - a * x,
+                  bxz - a * y, byz + a * x, c + b * z * z};
+    for (int j = 0; j < count; j++) {
+      for (int e = 0; e < 9; e++) {
+        out (e / 3, 3 * (first + j) + e % 3) = m[e](j);
+      }
+    }
+  }
+};
+
+// A rotation close to r, for an r that rounding has pushed slightly off
+// orthogonal: Gram-Schmidt on the first two columns, then their cross
+// product. Column 0 keeps its direction, so this is not the nearest
+// rotation (the polar factor), but the difference is of the order of the
+// drift it removes.
+template <typename Derived>
+Eigen::Matrix<typename Derived::Scalar, 3, 3>
+orthonormalize (const Eigen::MatrixBase<Derived>& r) {
+  Eigen::Matrix<typename Derived::Scalar, 3, 3> m;
+  m.col (0) = r.col (0).normalized ();
+  m.col (1) = (r.col (1) - m.col (0).dot (r.col (1)) * m.col (0))
+    .normalized ();
+  m.col (2) = m.col (0).cross (m.col (1));
+  return m;
+};
+
+#endif
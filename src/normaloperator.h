@@ -0,0 +1,78 @@
+#ifndef NORMALOPERATOR_H
+#define NORMALOPERATOR_H
+
+#include "Eigen/Dense"
+#include "Eigen/SparseCore"
+#include "Eigen/IterativeLinearSolvers"
+#include "jacobian.h"
+
+// The damped normal equations J^T J + lambda^2 I of an arm, as a
+// matrix-free operator Eigen's iterative solvers accept. Multiplying by a
+// vector costs one J v and one J^T u, so O(N), and J^T J (3N x 3N) is
+// never formed. This is the matrix-free pattern from Eigen's
+// "Matrix-free solvers" page.
+
+template <typename Scalar>
+class NormalOperator;
+
+namespace Eigen {
+namespace internal {
+  // Reuse the traits of a sparse matrix, as Eigen's own example does.
+  template<typename Scalar>
+  struct traits<NormalOperator<Scalar> >
+    : public Eigen::internal::traits<Eigen::SparseMatrix<Scalar> > {};
+}
+}
+
+template <typename _Scalar>
+class NormalOperator : public Eigen::EigenBase<NormalOperator<_Scalar> > {
+  private:
+    ArmJacobian<_Scalar> jac;
+    _Scalar lambda2;
+  public:
+    typedef _Scalar Scalar;
+    typedef _Scalar RealScalar;
+    typedef int StorageIndex;
+    enum {
+      ColsAtCompileTime = Eigen::Dynamic,
+      MaxColsAtCompileTime = Eigen::Dynamic,
+      IsRowMajor = false
+    };
+
+    NormalOperator (const ArmJacobian<Scalar>& jac, Scalar lambda)
+      : jac (jac), lambda2 (lambda * lambda) {};
+    Eigen::Index rows (void) const { return this->jac.cols (); };
+    Eigen::Index cols (void) const { return this->jac.cols (); };
+    const ArmJacobian<Scalar>& jacobian (void) const { return this->jac; };
+    Scalar damping2 (void) const { return this->lambda2; };
+
+    template<typename Rhs>
+    Eigen::Product<NormalOperator, Rhs, Eigen::AliasFreeProduct>
+      operator* (const Eigen::MatrixBase<Rhs>& x) const {
+      return Eigen::Product<NormalOperator, Rhs, Eigen::AliasFreeProduct>
+        (*this, x.derived ());
+    };
+};
+
+namespace Eigen {
+namespace internal {
+  // dst += alpha (J^T J + lambda^2 I) rhs, through the jacobian operator.
+  template<typename S, typename Rhs>
+  struct generic_product_impl<NormalOperator<S>, Rhs, SparseShape, DenseShape,
+                              GemvProduct>
+    : generic_product_impl_base<NormalOperator<S>, Rhs,
+          generic_product_impl<NormalOperator<S>, Rhs> > {
+    typedef typename Product<NormalOperator<S>, Rhs>::Scalar Scalar;
+
+    template<typename Dest>
+    static void scaleAndAddTo (Dest& dst, const NormalOperator<S>& lhs,
+                               const Rhs& rhs, const Scalar& alpha) {
+      dst += (alpha * lhs.damping2 ()) * rhs;
+      lhs.jacobian ().addTransposeTimes (alpha * (lhs.jacobian () * rhs),
+                                         dst);
+    };
+  };
+}
+}
+
+#endif
@@ -0,0 +1,246 @@
+#include "skeleton.h"
+#include "kinematics.h"
+#include <cassert>
+#include <algorithm>
+
+using namespace Eigen;
+using namespace std;
+
+Skeleton::Skeleton (float x, float y, float z)
+  : points (3, 1), parents (1, -1), rest (3, 1), jointOf (1, -1),
+    laidOut (false), damping (DEFAULT_DAMPING), unnormalized (0) {
+  this->points.col (0) = Vector3f (x, y, z);
+  this->rest.setZero ();
+};
+
+// Adds a point at (x, y, z) hanging from point parent, and returns its
+// index. parent becomes a joint if it wasn't one already.
+int Skeleton::addBone (int parent, float x, float y, float z) {
+  int n = this->points.cols ();
+  assert (parent >= 0 && parent < n);
+  if (this->jointOf[parent] < 0) {
+    int joints = this->jointPoints.size ();
+    this->jointOf[parent] = joints;
+    this->jointPoints.push_back (parent);
+    this->rotations.conservativeResize (NoChange, 3 * (joints + 1));
+    this->rotations.block<3,3>(0,3*joints).setIdentity ();
+    this->turns.resize (3, 3 * (joints + 1));
+    this->expmaps.resize (3, joints + 1);
+  }
+  // The new bone rests where it is placed, relative to its parent's
+  // current rotation.
+  Vector3f point (x, y, z);
+  this->points.conservativeResize (NoChange, n + 1);
+  this->rest.conservativeResize (NoChange, n + 1);
+  this->points.col (n) = point;
+  this->rest.col (n) = this->rotations.block<3,3>(0,3*this->jointOf[parent])
+    .transpose () * (point - this->points.col (parent));
+  this->parents.push_back (parent);
+  this->jointOf.push_back (-1);
+  this->laidOut = false;
+  return n;
+};
+
+// Makes point an effector and returns its index, which is the column of
+// its goal in the goals passed to stepTowards.
+int Skeleton::addEffector (int point) {
+  assert (point >= 0 && point < this->points.cols ());
+  this->effectors.push_back (point);
+  this->laidOut = false;
+  return this->effectors.size () - 1;
+};
+
+void Skeleton::setDamping (float lambda) {
+  this->damping = lambda;
+};
+
+int Skeleton::numPoints (void) const {
+  return this->points.cols ();
+};
+
+int Skeleton::numJoints (void) const {
+  return this->jointPoints.size ();
+};
+
+int Skeleton::numEffectors (void) const {
+  return this->effectors.size ();
+};
+
+// The point a point hangs from; -1 for the root.
+int Skeleton::parent (int point) const {
+  return this->parents[point];
+};
+
+// The point effector f is on.
+int Skeleton::effector (int f) const {
+  return this->effectors[f];
+};
+
+const Matrix3Xf& Skeleton::getPoints (void) const {
+  return this->points;
+};
+
+// Builds the pattern of J, and sizes the solver workspace, for the
+// current bones and effectors. Effector f depends on each joint on the
+// path from it to the root. Column k of crossmat (d) is zero in row k, so
+// each such block has six non-zeros.
+void Skeleton::layout (void) {
+  int effectors = this->effectors.size ();
+  int joints = this->jointPoints.size ();
+  vector<Triplet<float> > entries;
+  for (int f = 0; f < effectors; f++) {
+    for (int p = this->parents[this->effectors[f]]; p >= 0;
+         p = this->parents[p]) {
+      int c = this->jointOf[p];
+      for (int k = 0; k < 3; k++) {
+        for (int r = 0; r < 3; r++) {
+          if (r != k) entries.push_back (Triplet<float> (3*f+r, 3*c+k, 0));
+        }
+      }
+    }
+  }
+  this->jac.resize (3 * effectors, 3 * joints);
+  this->jac.setFromTriplets (entries.begin (), entries.end ());
+  this->jac.makeCompressed ();
+  this->gram.resize (3 * effectors, 3 * effectors);
+  this->ldlt = LDLT<MatrixXf> (3 * effectors);
+  this->err.resize (3 * effectors);
+  this->y.resize (3 * effectors);
+  this->expmaps.setZero ();
+  this->laidOut = true;
+};
+
+// Writes the current values into the pattern. The three columns of
+// joint c have the same effectors, two rows each, in order, and the
+// block for effector f is crossmat (d) for d = joint - effector.
+void Skeleton::fillJacobian (void) {
+  float* values = this->jac.valuePtr ();
+  const int* rows = this->jac.innerIndexPtr ();
+  const int* outer = this->jac.outerIndexPtr ();
+  for (int c = 0; c < this->jac.cols () / 3; c++) {
+    Vector3f joint = this->points.col (this->jointPoints[c]);
+    int begin = outer[3*c], count = outer[3*c+1] - begin;
+    float* v0 = values + begin;
+    float* v1 = v0 + count;
+    float* v2 = v1 + count;
+    for (int a = 0; a < count; a += 2) {
+      Vector3f d = joint - this->points.col (this->effectors[rows[begin+a]/3]);
+      v0[a] = d(2); v0[a+1] = -d(1);
+      v1[a] = -d(2); v1[a+1] = d(0);
+      v2[a] = d(1); v2[a+1] = -d(0);
+    }
+  }
+};
+
+// The jacobian of the stacked effector positions with respect to the
+// joint expmaps, 3E x 3J, in the current pose.
+const Skeleton::SparseJacobian& Skeleton::jacobian (void) {
+  if (!this->laidOut) layout ();
+  fillJacobian ();
+  return this->jac;
+};
+
+// Rotates each joint by its column of expmaps (scaled by STEP_SIZE, see
+// rodriguez), carrying its descendants along, then rebuilds the points
+// from the root. Joints are numbered parents first, so each joint's turn
+// is its parent's turn times its own.
+void Skeleton::applyRotations (const Matrix3Xf& expmaps) {
+  int joints = this->jointPoints.size ();
+  bool renormalize = ++this->unnormalized >= DEFAULT_RENORMALIZATION;
+  if (renormalize) this->unnormalized = 0;
+  // Each joint's own rotation goes into turns first; a joint's turn is
+  // then made whole from its parent's, which is already whole.
+  rodriguezBatch (expmaps.leftCols (joints), this->turns);
+  for (int c = 0; c < joints; c++) {
+    int up = this->parents[this->jointPoints[c]];
+    Matrix3f turn = this->turns.block<3,3>(0,3*c);
+    if (up >= 0) turn = this->turns.block<3,3>(0,3*this->jointOf[up]) * turn;
+    Matrix3f rotation = turn * this->rotations.block<3,3>(0,3*c);
+    if (renormalize) rotation = orthonormalize (rotation);
+    this->rotations.block<3,3>(0,3*c) = rotation;
+    this->turns.block<3,3>(0,3*c) = turn;
+  }
+  forwardKinematics ();
+};
+
+// Places each point at its parent plus its bone's rest offset, turned by
+// the parent's rotation. The root never moves.
+void Skeleton::forwardKinematics (void) {
+  for (int p = 1; p < this->points.cols (); p++) {
+    int up = this->parents[p], c = this->jointOf[up];
+    this->points.col (p) = this->points.col (up)
+      + this->rotations.block<3,3>(0,3*c) * this->rest.col (p);
+  }
+};
+
+// Steps every effector f towards goals.col (f). J J^T is accumulated
+// joint by joint: joint c adds crossmat (d_g) crossmat (d_f)^T =
+// (d_f . d_g) I - d_f d_g^T at block (g, f) for each pair of effectors
+// f <= g it moves, so only the lower triangle, which is all LDLT reads.
+void Skeleton::stepTowards (const Matrix3Xf& goals) {
+  int effectors = this->effectors.size ();
+  assert (goals.cols () == effectors);
+  if (effectors == 0 || this->jointPoints.empty ()) return;
+  jacobian ();
+  for (int f = 0; f < effectors; f++) {
+    this->err.segment<3>(3*f) =
+      goals.col (f) - this->points.col (this->effectors[f]);
+  }
+  const float* values = this->jac.valuePtr ();
+  const int* rows = this->jac.innerIndexPtr ();
+  const int* outer = this->jac.outerIndexPtr ();
+  this->gram.setZero ();
+  for (int c = 0; c < this->jac.cols () / 3; c++) {
+    int begin = outer[3*c], count = outer[3*c+1] - begin;
+    // d is read back from the first column, (0, d(2), -d(1)), and the
+    // second, (-d(2), 0, d(0)).
+    for (int a = 0; a < count; a += 2) {
+      int f = rows[begin+a] / 3;
+      Vector3f df (values[begin+count+a+1], -values[begin+a+1],
+                   values[begin+a]);
+      for (int b = a; b < count; b += 2) {
+        int g = rows[begin+b] / 3;
+        Vector3f dg (values[begin+count+b+1], -values[begin+b+1],
+                     values[begin+b]);
+        Matrix3f block = -df * dg.transpose ();
+        block.diagonal ().array () += df.dot (dg);
+        this->gram.block<3,3>(3*g,3*f) += block;
+      }
+    }
+  }
+  this->gram.diagonal ().array () += this->damping * this->damping;
+  this->ldlt.compute (this->gram);
+  this->y = this->ldlt.solve (this->err);
+  Map<VectorXf> x (this->expmaps.data (), this->expmaps.size ());
+  x.noalias () = this->jac.transpose () * this->y;
+  applyRotations (this->expmaps);
+};
+
+// The largest distance from an effector to its goal.
+float Skeleton::error (const Matrix3Xf& goals) const {
+  float largest = 0;
+  for (int f = 0; f < (int) this->effectors.size (); f++) {
+    largest = max (largest,
+      (goals.col (f) - this->points.col (this->effectors[f])).norm ());
+  }
+  return largest;
+};
+
+// Steps towards goals until every effector is within tolerance of its
+// goal or maxIters steps have been taken. Goals out of reach all at once
+// settle on a least-squares compromise and stop at maxIters.
+IKResult Skeleton::solve (const Matrix3Xf& goals, float tolerance,
+                          int maxIters) {
+  IKResult result;
+  result.iterations = 0;
+  result.status = IK_MAX_ITERATIONS;
+  result.error = error (goals);
+  while (result.error > tolerance) {
+    if (result.iterations >= maxIters) return result;
+    stepTowards (goals);
+    result.iterations++;
+    result.error = error (goals);
+  }
+  result.status = IK_CONVERGED;
+  return result;
+};
@@ -0,0 +1,68 @@
+#ifndef SKELETON_H
+#define SKELETON_H
+
+#include "Eigen/Dense"
+#include "Eigen/SparseCore"
+#include "arm.h"
+#include <vector>
+
+// A branching skeleton with several end effectors, each with its own goal,
+// solved together. Points are numbered in the order they are added, the
+// root first, so a point's parent always comes before it. Every point
+// with children is a ball joint, and turning it carries all of its
+// descendants along, as in Arm; any point can be an effector.
+//
+// The jacobian stacks one 3-row block per effector, with a 3x3 block
+// crossmat (joint - effector) wherever the joint is an ancestor of the
+// effector, and zero elsewhere. A hand doesn't depend on the other arm or
+// the legs, so most of J is zero, and it is kept as a sparse matrix whose
+// pattern is built once, when the skeleton changes, and whose values are
+// refilled in place every step. Steps are damped least squares in
+// effector space, x = J^T (J J^T + lambda^2 I)^-1 err, where J J^T is
+// only 3E x 3E for E effectors. Forming it, and both products with J,
+// take time proportional to the non-zeros rather than joints x effectors,
+// and nothing is allocated once the workspace is sized.
+
+class Skeleton {
+  public:
+    typedef Eigen::SparseMatrix<float> SparseJacobian;
+  private:
+    Eigen::Matrix3Xf points;
+    std::vector<int> parents;
+    Eigen::Matrix3Xf rest;
+    std::vector<int> jointOf;          // Column block of each point, or -1.
+    std::vector<int> jointPoints;      // The point of each column block.
+    Eigen::Matrix3Xf rotations;        // One 3x3 per joint.
+    Eigen::Matrix3Xf turns;
+    Eigen::Matrix3Xf expmaps;
+    std::vector<int> effectors;
+    SparseJacobian jac;
+    Eigen::MatrixXf gram;
+    Eigen::LDLT<Eigen::MatrixXf> ldlt;
+    Eigen::VectorXf err, y;
+    bool laidOut;
+    float damping;
+    int unnormalized;
+    void layout (void);
+    void fillJacobian (void);
+    void forwardKinematics (void);
+  public:
+    Skeleton (float x, float y, float z);
+    int addBone (int parent, float x, float y, float z);
+    int addEffector (int point);
+    void applyRotations (const Eigen::Matrix3Xf& expmaps);
+    const SparseJacobian& jacobian (void);
+    void stepTowards (const Eigen::Matrix3Xf& goals);
+    IKResult solve (const Eigen::Matrix3Xf& goals, float tolerance,
+                    int maxIters);
+    void setDamping (float lambda);
+    float error (const Eigen::Matrix3Xf& goals) const;
+    int numPoints (void) const;
+    int numJoints (void) const;
+    int numEffectors (void) const;
+    int parent (int point) const;
+    int effector (int f) const;
+    const Eigen::Matrix3Xf& getPoints (void) const;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include <iostream>
+#include <cstdlib>
+#include "arm.h"
+
+using namespace std;
+using namespace Eigen;
+
+/*
+Checks that Arm::stepTowards never touches the heap once the arm is
+built. Steps every solver except IK_CG (whose Eigen solver allocates) on
+chains of 1 to 256 joints, ball joints, hinges and limited joints, with
+position goals, pose goals and nullspace objectives, after one warm-up
+step, and fails if any step allocates.
+
+Usage: test_alloc
+*/
+
+// Counts heap allocations, as in bench_arm. Eigen allocates with malloc
+// directly, so hook that rather than operator new. Only done where glibc
+// makes it easy; elsewhere there is nothing to check.
+#ifdef __GLIBC__
+static long allocations = 0;
+extern "C" void *__libc_malloc (size_t size);
+extern "C" void *__libc_realloc (void *ptr, size_t size);
+extern "C" void *malloc (size_t size) {
+  allocations++;
+  return __libc_malloc (size);
+}
+extern "C" void *realloc (void *ptr, size_t size) {
+  allocations++;
+  return __libc_realloc (ptr, size);
+}
+#endif
+
+// Steps between goal changes, and goal changes per check.
+#define HOLD_STEPS 8
+#define GOALS 6
+
+enum Chain { BALL, HINGE, LIMITED };
+
+// Builds an arm along x with the given number of rotating joints. Every
+// other joint of a HINGE chain is a hinge about z; a LIMITED chain
+// bounds each joint to half a radian about every axis.
+static Arm makeArm (int length, IKSolver solver, Chain chain) {
+  Arm arm;
+  arm.setSolver (solver);
+  for (int i = 1; i <= length; i++) {
+    float x = 4.f * i / length;
+    if (chain == HINGE && i % 2 == 0) {
+      arm.addJoint (x, 0, 0, JointAxes (Vector3f (0, 0, 1)),
+                    JointLimits ());
+    } else if (chain == LIMITED) {
+      arm.addJoint (x, 0, 0, JointLimits (Vector3f::Constant (-.5f),
+                                          Vector3f::Constant (.5f)));
+    } else {
+      arm.addJoint (x, 0, 0);
+    }
+  }
+  return arm;
+}
+
+// Allocations made by the steps after the first, moving between goals
+// that each hold for a few steps so the coherence cache is used too.
+static long countSteps (Arm& arm, bool pose) {
+  Vector3f goals[] = {Vector3f (1, 2, 1), Vector3f (-1, 1, 2)};
+  Matrix3f orientation = AngleAxisf (.5f, Vector3f::UnitY ())
+    .toRotationMatrix ();
+  long before = 0;
+  for (int step = 0; step <= HOLD_STEPS * GOALS; step++) {
+    // The warm-up step is allowed whatever it needs.
+    if (step == 1) before = allocations;
+    Vector3f goal = goals[(step / HOLD_STEPS) % 2];
+    if (pose) arm.stepTowards (goal, orientation, PoseWeights::Ones ());
+    else arm.stepTowards (goal);
+  }
+  return allocations - before;
+}
+
+int main (void) {
+#ifdef __GLIBC__
+  const char *names[] = {"svd", "dls", "sdls", "transpose", "ccd",
+                         "fabrik", "lm"};
+  IKSolver solvers[] = {IK_SVD, IK_DLS, IK_SDLS, IK_TRANSPOSE, IK_CCD,
+                        IK_FABRIK, IK_LM};
+  const char *chains[] = {"ball", "hinge", "limited"};
+  int lengths[] = {1, 2, 3, 4, 16, 64, 256};
+  int failures = 0;
+  for (int s = 0; s < 7; s++) {
+    for (int c = 0; c < 3; c++) {
+      for (int l = 0; l < 7; l++) {
+        for (int variant = 0; variant < 3; variant++) {
+          Arm arm = makeArm (lengths[l], solvers[s], Chain (c));
+          arm.setCoherence (.01f, 4);
+          if (variant == 2) arm.setNullspace (1, 1, 1);
+          long allocs = countSteps (arm, variant == 1);
+          if (allocs != 0) {
+            const char *goal[] = {"position", "pose", "nullspace"};
+            cout << names[s] << " " << chains[c] << " " << lengths[l]
+                 << " joints, " << goal[variant] << ": " << allocs
+                 << " allocations" << endl;
+            failures++;
+          }
+        }
+      }
+    }
+  }
+  if (failures > 0) return EXIT_FAILURE;
+  cout << "stepTowards made no allocations" << endl;
+#else
+  cout << "no allocation hook on this platform; skipped" << endl;
+#endif
+  return EXIT_SUCCESS;
+}